@@ -282,10 +282,12 @@ static int stage2_unmap_pud_range(struct mm_struct *vs, unsigned long addr, unsi
 	pud_t *pud;
 	pmd_t *pmdp;
 
-	pud = stage2_pud_offset((pud_t *)vs->pgdp, end);
+	pud = stage2_pud_offset((pud_t *)vs->pgdp, addr);
 	do {
 		next = stage2_pud_addr_end(addr, end);
-		if (!stage2_pud_none(*pud)) {
+		if (stage2_pud_huge(*pud)) {
+			stage2_pud_clear(pud);
+		} else if (!stage2_pud_none(*pud)) {
 			pmdp = (pmd_t *)ptov(stage2_pmd_table_addr(*pud));
 			stage2_unmap_pmd_range(vs, pmdp, addr, next);
 			if (is_pud_range(addr, next)) {
@@ -443,6 +445,7 @@ static inline int stage2_ipa_to_pa(struct mm_struct *vs,
 {
 	unsigned long pte_offset = va & ~S2_PTE_MASK;
 	unsigned long pmd_offset = va & ~S2_PMD_MASK;
+	unsigned long pud_offset = va & ~S2_PUD_MASK;
 	unsigned long phy = 0;
 	pud_t *pudp;
 	pmd_t *pmdp;
@@ -452,6 +455,11 @@ static inline int stage2_ipa_to_pa(struct mm_struct *vs,
 	if (stage2_pud_none(*pudp))
 		return -EFAULT;
 
+	if (stage2_pud_huge(*pudp)) {
+		*pa = ((*pudp) & S2_PHYSICAL_MASK) + pud_offset;
+		return 0;
+	}
+
 	pmdp = stage2_pmd_offset(ptov(stage2_pmd_table_addr(*pudp)), va);
 	if (stage2_pmd_none(*pmdp))
 		return -EFAULT;
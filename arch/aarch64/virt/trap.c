@@ -190,12 +190,6 @@ static int access_system_reg_handler(gp_regs *reg, int ec, uint32_t esr_value)
 	return ret;
 }
 
-static int insabort_tfl_handler(gp_regs *reg, int ec, uint32_t esr_value)
-{
-	panic("%s\n", __func__);
-	return 0;
-}
-
 static int misaligned_pc_handler(gp_regs *reg, int ec, uint32_t esr_value)
 {
 	panic("%s\n", __func__);
@@ -238,6 +232,49 @@ static inline bool dabt_iswrite(uint32_t esr_value)
 			(!!(esr_value & ESR_ELx_S1PTW));
 }
 
+/*
+ * the translation fault on the on demand memory of the vm, the
+ * memory block is mapped and the instruction is executed again.
+ * return -ENOENT if the fault is not on the on demand memory, if
+ * the memory block can not be populated the vcpu is faulted.
+ */
+static int guest_demand_fault(gp_regs *regs, uint32_t esr_value)
+{
+	uint32_t fsc = esr_value & ESR_ELx_FSC_TYPE;
+	unsigned long ipa;
+	int ret;
+
+	if (fsc != FSC_FAULT)
+		return -ENOENT;
+
+	ipa = get_faulting_ipa(read_sysreg(FAR_EL2));
+	ret = vm_demand_fault(get_current_vm(), ipa);
+	if (ret == -ENOENT)
+		return ret;
+
+	if (ret) {
+		pr_err("populate on demand memory 0x%x failed %d\n", ipa, ret);
+		vcpu_fault(current_vcpu, regs);
+		return -EFAULT;
+	}
+
+	regs->pc -= 4;
+
+	return 0;
+}
+
+static int insabort_tfl_handler(gp_regs *reg, int ec, uint32_t esr_value)
+{
+	int ret;
+
+	ret = guest_demand_fault(reg, esr_value);
+	if (ret != -ENOENT)
+		return ret;
+
+	panic("%s\n", __func__);
+	return 0;
+}
+
 static int dataabort_tfl_handler(gp_regs *regs, int ec, uint32_t esr_value)
 {
 	uint32_t dfsc = esr_value & ESR_ELx_FSC_TYPE;
@@ -255,6 +292,10 @@ static int dataabort_tfl_handler(gp_regs *regs, int ec, uint32_t esr_value)
 		goto out_fail;
 	}
 
+	ret = guest_demand_fault(regs, esr_value);
+	if (ret != -ENOENT)
+		return ret;
+
 	if (!(esr_value & ESR_ELx_ISV)) {
 		pr_err("Instruction syndrome not valid\n");
 		goto out_fail;
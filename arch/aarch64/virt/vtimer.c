@@ -45,6 +45,12 @@
 #define ACCESS_REG		0x0
 #define ACCESS_MEM		0x1
 
+/*
+ * the virtual timer of the vcpu which is switched out is put
+ * to the sleep_list of the pcpu, sleep_cpu is the pcpu and
+ * deadline is when the virtual timer will fire in ns, -1 means
+ * it is not in any sleep_list.
+ */
 struct vtimer {
 	struct vcpu *vcpu;
 	struct timer timer;
@@ -52,6 +58,9 @@ struct vtimer {
 	uint32_t cnt_ctl;
 	uint64_t cnt_cval;
 	uint64_t freq;
+	int sleep_cpu;
+	uint64_t deadline;
+	struct list_head sleep_list;
 };
 
 struct vtimer_context {
@@ -60,6 +69,23 @@ struct vtimer_context {
 	unsigned long offset;
 };
 
+/*
+ * one timer for all the virtual timers of the switched out
+ * vcpus on this pcpu, it is armed for the earliest deadline,
+ * next is the expires it is armed for, 0 means not armed. the
+ * timer is not stopped when a vcpu is switched in, the handler
+ * will find it is not in the list and re-arm the timer for the
+ * next deadline.
+ */
+struct vtimer_pcpu {
+	spinlock_t lock;
+	struct list_head sleep_list;
+	struct timer timer;
+	uint64_t next;
+};
+
+static DEFINE_PER_CPU(struct vtimer_pcpu, vtimer_pcpu);
+
 static int arm_phy_timer_trap(struct vcpu *vcpu,
 		int reg, int read, unsigned long *value);
 
@@ -81,9 +107,12 @@ static void phys_timer_expire_function(unsigned long data)
 		send_virq_to_vcpu(vtimer->vcpu, vtimer->virq);
 }
 
-static void virt_timer_expire_function(unsigned long data)
+static void vtimer_pcpu_handler(unsigned long data)
 {
-	struct vtimer *vtimer = (struct vtimer *)data;
+	struct vtimer_pcpu *vp = (struct vtimer_pcpu *)data;
+	struct vtimer *vtimer, *n;
+	uint64_t now = NOW(), next = 0;
+	unsigned long flags;
 
 	/*
 	 * just wake up the target vCPU. when switch to
@@ -91,7 +120,60 @@ static void virt_timer_expire_function(unsigned long data)
 	 * if the irq is not mask, the vtimer will trigger
 	 * the hardware irq again.
 	 */
-	wake(&vtimer->vcpu->vcpu_event);
+	spin_lock_irqsave(&vp->lock, flags);
+	list_for_each_entry_safe(vtimer, n, &vp->sleep_list, sleep_list) {
+		if (vtimer->deadline <= now) {
+			list_del(&vtimer->sleep_list);
+			vtimer->sleep_cpu = -1;
+			wake(&vtimer->vcpu->vcpu_event);
+		} else if (!next || (vtimer->deadline < next)) {
+			next = vtimer->deadline;
+		}
+	}
+
+	vp->next = next;
+	if (next)
+		mod_timer(&vp->timer, next);
+	spin_unlock_irqrestore(&vp->lock, flags);
+}
+
+static void vtimer_sleep_add(struct vtimer *vtimer, int cpu, uint64_t deadline)
+{
+	struct vtimer_pcpu *vp = &get_per_cpu(vtimer_pcpu, cpu);
+	unsigned long flags;
+
+	spin_lock_irqsave(&vp->lock, flags);
+	vtimer->deadline = deadline;
+	vtimer->sleep_cpu = cpu;
+	list_add_tail(&vp->sleep_list, &vtimer->sleep_list);
+
+	/*
+	 * only arm the timer when the deadline is earlier than
+	 * the one the timer is armed for.
+	 */
+	if (!vp->next || (deadline < vp->next)) {
+		vp->next = deadline;
+		mod_timer_on(&vp->timer, deadline, cpu);
+	}
+	spin_unlock_irqrestore(&vp->lock, flags);
+}
+
+static void vtimer_sleep_del(struct vtimer *vtimer)
+{
+	struct vtimer_pcpu *vp;
+	unsigned long flags;
+	int cpu = vtimer->sleep_cpu;
+
+	if (cpu == -1)
+		return;
+
+	vp = &get_per_cpu(vtimer_pcpu, cpu);
+	spin_lock_irqsave(&vp->lock, flags);
+	if (vtimer->sleep_cpu == cpu) {
+		list_del(&vtimer->sleep_list);
+		vtimer->sleep_cpu = -1;
+	}
+	spin_unlock_irqrestore(&vp->lock, flags);
 }
 
 static void vtimer_state_restore(struct vcpu *vcpu, void *context)
@@ -99,7 +181,7 @@ static void vtimer_state_restore(struct vcpu *vcpu, void *context)
 	struct vtimer_context *c = (struct vtimer_context *)context;
 	struct vtimer *vtimer = &c->virt_timer;
 
-	stop_timer(&vtimer->timer);
+	vtimer_sleep_del(vtimer);
 
 	write_sysreg64(c->offset, ARM64_CNTVOFF_EL2);
 	write_sysreg64(vtimer->cnt_cval, ARM64_CNTV_CVAL_EL0);
@@ -122,10 +204,14 @@ static void vtimer_state_save(struct vcpu *vcpu, void *context)
 			(task->state == TASK_STATE_SUSPEND))
 		return;
 
+	/*
+	 * NOW() is not based on the boot_tick, the backup timer
+	 * need to expire at cval + CNTVOFF of the physical counter.
+	 */
 	if ((vtimer->cnt_ctl & CNT_CTL_ENABLE) &&
 		!(vtimer->cnt_ctl & CNT_CTL_IMASK)) {
-		mod_timer(&vtimer->timer, ticks_to_ns(vtimer->cnt_cval +
-				c->offset - boot_tick));
+		vtimer_sleep_add(vtimer, smp_processor_id(),
+			ticks_to_ns(vtimer->cnt_cval + c->offset));
 	}
 }
 
@@ -147,15 +233,15 @@ static void vtimer_state_init(struct vcpu *vcpu, void *context)
 	vtimer->virq = vcpu->vm->vtimer_virq;
 	vtimer->cnt_ctl = 0;
 	vtimer->cnt_cval = 0;
-	init_timer(&vtimer->timer, virt_timer_expire_function,
-			(unsigned long)vtimer);
+	vtimer->sleep_cpu = -1;
 
 	vtimer = &c->phy_timer;
 	vtimer->vcpu = vcpu;
 	vtimer->virq = 26;
 	vtimer->cnt_ctl = 0;
 	vtimer->cnt_cval = 0;
-	init_timer(&vtimer->timer, phys_timer_expire_function,
+	vtimer->sleep_cpu = -1;
+	init_hres_timer(&vtimer->timer, phys_timer_expire_function,
 			(unsigned long)vtimer);
 }
 
@@ -163,10 +249,24 @@ static void vtimer_state_stop(struct vcpu *vcpu, void *context)
 {
 	struct vtimer_context *c = (struct vtimer_context *)context;
 
-	stop_timer(&c->virt_timer.timer);
+	vtimer_sleep_del(&c->virt_timer);
 	stop_timer(&c->phy_timer.timer);
 }
 
+static void vtimer_state_migrate(struct vcpu *vcpu, void *context, int cpu)
+{
+	struct vtimer_context *c = (struct vtimer_context *)context;
+	struct vtimer *vtimer = &c->virt_timer;
+	int old = vtimer->sleep_cpu;
+
+	if ((old != -1) && (old != cpu)) {
+		vtimer_sleep_del(vtimer);
+		vtimer_sleep_add(vtimer, cpu, vtimer->deadline);
+	}
+
+	migrate_timer(&c->phy_timer.timer, cpu);
+}
+
 static inline void
 asoc_handle_cntp_ctl(struct vcpu *vcpu, struct vtimer *vtimer)
 {
@@ -206,9 +306,12 @@ static void vtimer_handle_cntp_ctl(struct vcpu *vcpu, int access,
 			v |= vtimer->cnt_ctl & CNT_CTL_ISTATUS;
 		vtimer->cnt_ctl = v;
 
+		/*
+		 * cnt_cval already include the offset.
+		 */
 		if ((vtimer->cnt_ctl & CNT_CTL_ENABLE) &&
 				(vtimer->cnt_cval != 0)) {
-			ns = ticks_to_ns(vtimer->cnt_cval + c->offset);
+			ns = ticks_to_ns(vtimer->cnt_cval);
 			mod_timer(&vtimer->timer, ns);
 		} else {
 			stop_timer(&vtimer->timer);
@@ -293,6 +396,7 @@ static int vtimer_vmodule_init(struct vmodule *vmodule)
 	vmodule->state_restore = vtimer_state_restore;
 	vmodule->state_stop = vtimer_state_stop;
 	vmodule->state_reset = vtimer_state_stop;
+	vmodule->state_migrate = vtimer_state_migrate;
 	vtimer_vmodule_id = vmodule->id;
 
 	return 0;
@@ -300,6 +404,18 @@ static int vtimer_vmodule_init(struct vmodule *vmodule)
 
 int arch_vtimer_init(uint32_t virtual_irq, uint32_t phy_irq)
 {
+	struct vtimer_pcpu *vp;
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		vp = &get_per_cpu(vtimer_pcpu, cpu);
+		spin_lock_init(&vp->lock);
+		init_list(&vp->sleep_list);
+		init_hres_timer(&vp->timer, vtimer_pcpu_handler,
+				(unsigned long)vp);
+		vp->next = 0;
+	}
+
 	return register_vcpu_vmodule("vtimer_module", vtimer_vmodule_init);
 }
 
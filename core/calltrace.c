@@ -144,6 +144,23 @@ void print_symbol(unsigned long addr)
 			symbol_right - symbol_left);
 }
 
+/*
+ * return the name of the symbol which the address belongs
+ * to and the offset of the address in the symbol.
+ */
+char *lookup_symbol(unsigned long addr, unsigned long *offset)
+{
+	int pos;
+
+	pos = locate_symbol_pos(addr);
+	if (pos == -1)
+		return NULL;
+
+	*offset = addr - allsyms_address[pos];
+
+	return allsyms_names + allsyms_offset[pos];
+}
+
 int allsymbols_init(void)
 {
 	int *tmp;
@@ -103,6 +103,12 @@ int __wake_up_event_waiter(struct event *ev, void *msg,
 
 	num = opt & OS_EVENT_OPT_BROADCAST ? 0 : 1;
 
+	/*
+	 * broadcast may wake up many tasks on other pcpus, send
+	 * only one irqwork to each pcpu.
+	 */
+	wakeup_batch_begin();
+
 	do {
 		task = get_event_waiter(ev);
 		if (!task)
@@ -116,6 +122,8 @@ int __wake_up_event_waiter(struct event *ev, void *msg,
 			break;
 	} while (1);
 
+	wakeup_batch_end();
+
 	return cnt;
 }
 
@@ -252,6 +252,7 @@ flag_t flag_post(struct flag_grp *grp, flag_t flags, int opt)
 	if (opt > FLAG_SET)
 		return -EINVAL;
 
+	wakeup_batch_begin();
 	spin_lock_irqsave(&grp->lock, irq);
 	switch (opt) {
 	case FLAG_CLR:
@@ -290,11 +291,13 @@ flag_t flag_post(struct flag_grp *grp, flag_t flags, int opt)
 
 		default:
 			spin_unlock_irqrestore(&grp->lock, irq);
+			wakeup_batch_end();
 			return 0;
 		}
 	}
 
 	spin_unlock_irqrestore(&grp->lock, irq);
+	wakeup_batch_end();
 
 	cond_resched();
 
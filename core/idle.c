@@ -59,7 +59,7 @@ int system_suspend(void)
 
 static inline bool pcpu_can_idle(struct pcpu *pcpu)
 {
-	return (pcpu->local_rdy_grp == (1 << OS_PRIO_IDLE)) &&
+	return (pcpu_highest_prio(pcpu) == OS_PRIO_IDLE) &&
 		(is_list_empty(&pcpu->stop_list));
 }
 
@@ -109,6 +109,12 @@ static int kworker_task(void *data)
 
 		if (flag & KWORKER_TASK_RECYCLE)
 			pcpu_release_task(pcpu);
+
+		if (flag & KWORKER_MM_RECLAIM)
+			mm_reclaim();
+
+		if (flag & KWORKER_HEAP_SHRINK)
+			mm_heap_shrink();
 	}
 
 	return 0;
@@ -138,6 +144,7 @@ static void start_system_task(void)
 void cpu_idle(void)
 {
 	struct pcpu *pcpu = get_pcpu();
+	unsigned long start;
 
 	start_system_task();
 
@@ -149,6 +156,13 @@ void cpu_idle(void)
 	while (1) {
 		sched();
 
+		/*
+		 * try to pull a task from the busiest pcpu before
+		 * going to idle state.
+		 */
+		if (pcpu_can_idle(pcpu))
+			sched_idle_balance();
+
 		/*
 		 * need to check whether the pcpu can go to idle
 		 * state to avoid the interrupt happend before wfi
@@ -157,8 +171,11 @@ void cpu_idle(void)
 			local_irq_disable();
 			if (pcpu_can_idle(pcpu)) {
 				pcpu->state = PCPU_STATE_IDLE;
+				start = NOW();
 				wfi();
 				nop();
+				pcpu->idle_ns += NOW() - start;
+				pcpu->nr_idle_enter++;
 				pcpu->state = PCPU_STATE_RUNNING;
 			}
 			local_irq_enable();
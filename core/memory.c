@@ -17,6 +17,11 @@
 #include <minos/minos.h>
 #include <minos/mm.h>
 #include <minos/memory.h>
+#include <minos/bitmap.h>
+#ifdef CONFIG_VIRT
+#include <virt/vmm.h>
+#endif
+
 #ifdef CONFIG_DEVICE_TREE
 #include <libfdt/libfdt.h>
 #endif
@@ -25,186 +30,846 @@
 extern int of_mm_init(void);
 #endif
 
-struct slab_header {
-	unsigned long size;
-	union {
-		unsigned long magic;
-		struct slab_header *next;
-	};
-} __packed;
-
-struct slab_type {
-	uint32_t size;
-	struct list_head list;
-	struct slab_header *head;
-};
-
 #define PAGE_FLAGS_SHMEM (1 << 0)
+#define PAGE_FLAGS_USED	(1 << 1)
 
+/*
+ * the descriptor of each page managed by the page allocator,
+ * indexed by the pfn.
+ * order - order + 1 of the free block whose first page is
+ *         this page, 0 means it is not the head of a free block.
+ * flags - PAGE_FLAGS_USED is set at the first page of an
+ *         allocation, and cnt is the page count of it.
+ */
 struct page {
-	uint32_t pfn;
+	uint8_t order;
 	uint8_t flags;
-	uint8_t align;
 	uint16_t cnt;
-	struct page *next;
-} __packed;
-
-#define HASH_TABLE_SIZE	8
-
-#define SLAB_MEM_BASE (511UL * 1024 * 1024 * 1024)
-#define SLAB_MEM_SIZE (128UL * 1024 * 1024)
-#define SLAB_MEM_END (SLAB_MEM_BASE + SLAB_MEM_SIZE)
+};
 
+/*
+ * the memory of the slab allocator is allocated from the page
+ * allocator, each slab is SLAB_PAGES pages and aligned to the
+ * SLAB_SIZE, so the slab of an object can be found by masking
+ * its address. the allocation which is bigger than the biggest
+ * size class get its own pages with a slab header whose cache
+ * is NULL.
+ */
+#define SLAB_PAGES			4
+#define SLAB_SIZE			(SLAB_PAGES * PAGE_SIZE)
+#define SLAB_MASK			(~(SLAB_SIZE - 1))
+#define SLAB_MAGIC			(0xdeadbeef)
 #define SLAB_MIN_DATA_SIZE		(16)
 #define SLAB_MIN_DATA_SIZE_SHIFT	(4)
-#define SLAB_HEADER_SIZE		sizeof(struct slab_header)
-#define SLAB_MIN_SIZE			(SLAB_MIN_DATA_SIZE + SLAB_HEADER_SIZE)
-#define SLAB_MAGIC			(0xdeadbeef)
+#define SLAB_MAX_DATA_SIZE		(2048)
+#define SLAB_HEADER_SIZE		BALIGN(sizeof(struct slab), 64)
+#define SLAB_KEEP_EMPTY			1
+
+#define NR_SIZE_CLASSES			14
+#define MAG_SIZE			32
+
+struct kmem_cache;
 
 /*
- * will try to get hugepage when first time once
- * system bootup.
+ * free   - the free objects in this slab.
+ * inuse  - the objects allocated from this slab, include
+ *          the objects in the magazine.
+ * pages  - the page count of the big allocation.
  */
+struct slab {
+	unsigned long magic;
+	struct kmem_cache *cache;
+	struct list_head list;
+	void *free;
+	int inuse;
+	int pages;
+};
+
+/*
+ * each pcpu has a magazine for each cache, the object is
+ * allocated from and freed to the magazine without lock,
+ * the magazine is refilled from or flushed to the slabs
+ * of the cache when it is empty or full. the counters are
+ * only updated by the owner pcpu.
+ */
+struct magazine {
+	int nr;
+	unsigned long nr_alloc;
+	unsigned long nr_free;
+	void *objs[MAG_SIZE];
+} __cache_line_align;
+
+/*
+ * nr_inuse - the objects taken out of the slabs, include
+ *            the objects in the magazines.
+ * ctor     - called for each object allocated from the
+ *            cache by kmem_cache_alloc().
+ */
+struct kmem_cache {
+	char name[KMEM_CACHE_NAME_SIZE];
+	uint32_t size;
+	uint32_t nr_objs;
+	void (*ctor)(void *obj);
+	spinlock_t lock;
+	struct list_head partial;
+	struct list_head full;
+	struct list_head empty;
+	int nr_slabs;
+	int nr_empty;
+	unsigned long nr_inuse;
+	unsigned long nr_refill;
+	unsigned long nr_flush;
+	struct list_head cache_list;
+	struct magazine mag[NR_CPUS];
+};
+
+static const uint32_t size_class[NR_SIZE_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256,
+	384, 512, 768, 1024, 1536, 2048
+};
+
+static struct kmem_cache size_caches[NR_SIZE_CLASSES];
+static struct kmem_cache cache_cache;
+static LIST_HEAD(kmem_cache_list);
+static DEFINE_SPIN_LOCK(kmem_cache_lock);
+static uint8_t size_class_index[(SLAB_MAX_DATA_SIZE >> SLAB_MIN_DATA_SIZE_SHIFT) + 1];
+
+/*
+ * the pages between the end of minos image and the end of
+ * the minos memory are managed by the buddy allocator, a free
+ * block of order n is 2^n pages and aligned to 2^n pages, it
+ * is linked to free_area[n] by the list_head in its first page.
+ */
+#define BUDDY_MAX_ORDER		10
+#define NR_MINOS_PAGES		(CONFIG_MINOS_RAM_SIZE >> PAGE_SHIFT)
+
+struct free_area {
+	struct list_head list;
+	unsigned long nr_free;
+};
+
 static DEFINE_SPIN_LOCK(mm_lock);
-static void *slab_base;
-static void *page_base;
-static struct page *free_page_head;
-static struct page *used_page_head;
-static struct list_head slab_hash_table[HASH_TABLE_SIZE];
+static struct free_area free_area[BUDDY_MAX_ORDER + 1];
+static struct page page_table[NR_MINOS_PAGES];
+static unsigned long minos_start_pfn;
+static unsigned long buddy_start_pfn;
+static unsigned long buddy_end_pfn;
+static unsigned long nr_free_pages;
+static unsigned long nr_total_pages;
+static unsigned long nr_used_allocs;
+
+/*
+ * when the free pages is lower than the watermark, the kworker
+ * of each pcpu is asked to run the reclaim pass which returns
+ * the cached objects and the empty slabs to the page allocator,
+ * reclaim_pending is the pcpus which have not done the pass.
+ */
+static unsigned long low_watermark;
+static int reclaim_pending;
+static unsigned long nr_reclaim;
+static unsigned long nr_reclaim_pages;
+
+static void mm_heap_grow(void);
 
-#define hash_id(size) (((size) >> SLAB_MIN_DATA_SIZE_SHIFT) % HASH_TABLE_SIZE)
+#ifdef CONFIG_VIRT
+/*
+ * when the reclaim pass can not bring the free pages back over
+ * the high watermark, the heap borrows memory blocks from the
+ * vmm, the first page of the block holds the heap_block and the
+ * page descriptors of the block, the other pages are given to
+ * the buddy allocator. a free block inside the heap block can
+ * not merge with the block out of it, since the first page is
+ * never free and the heap block is aligned to its size. once all
+ * the pages of a heap block are free and the free pages is over
+ * the high watermark, the block is returned to the vmm.
+ */
+#define HEAP_BLOCK_PAGES	PAGES_IN_BLOCK
+#define HEAP_BLOCK_HASH		64
+
+struct heap_block {
+	unsigned long start_pfn;
+	unsigned long nr_free;
+	struct heap_block *next;
+	struct list_head list;
+	struct page pages[HEAP_BLOCK_PAGES];
+};
 
-static size_t inline get_slab_alloc_size(size_t size)
+static struct heap_block *heap_block_hash[HEAP_BLOCK_HASH];
+static LIST_HEAD(heap_block_list);
+static unsigned long nr_heap_blocks;
+static int heap_shrink_pending;
+#endif
+
+static inline struct kmem_cache *size_to_cache(size_t size)
+{
+	size = BALIGN(size, SLAB_MIN_DATA_SIZE) >> SLAB_MIN_DATA_SIZE_SHIFT;
+	return &size_caches[size_class_index[size]];
+}
+
+static inline struct slab *obj_to_slab(void *obj)
 {
-	return BALIGN(size, SLAB_MIN_DATA_SIZE);
+	return (struct slab *)(ULONG(obj) & SLAB_MASK);
 }
 
-static void *malloc_from_hash_table(size_t size)
+static struct slab *new_slab(struct kmem_cache *cache)
 {
-	int id = hash_id(size);
-	struct slab_type *st;
-	struct slab_header *sh;
+	struct slab *slab;
+	void *obj, *next;
+	int i;
+
+	slab = __get_free_pages(SLAB_PAGES, SLAB_PAGES);
+	if (!slab)
+		return NULL;
+
+	slab->magic = SLAB_MAGIC;
+	slab->cache = cache;
+	slab->inuse = 0;
+	slab->pages = SLAB_PAGES;
 
 	/*
-	 * find the related slab mem id and try to fetch
-	 * a free slab memory from the hash cache.
+	 * link all the objects to the free list of the slab,
+	 * the first word of the free object is the next one.
 	 */
-	list_for_each_entry(st, &slab_hash_table[id], list) {
-		if (st->size != size)
-			continue;
+	obj = (void *)slab + SLAB_HEADER_SIZE;
+	slab->free = obj;
+	for (i = 0; i < cache->nr_objs - 1; i++) {
+		next = obj + cache->size;
+		*(void **)obj = next;
+		obj = next;
+	}
+	*(void **)obj = NULL;
+
+	cache->nr_slabs++;
+
+	return slab;
+}
+
+static struct slab *cache_get_slab(struct kmem_cache *cache)
+{
+	struct slab *slab;
+
+	if (!is_list_empty(&cache->partial))
+		return list_first_entry(&cache->partial, struct slab, list);
 
-		if (st->head == NULL)
+	if (!is_list_empty(&cache->empty)) {
+		slab = list_first_entry(&cache->empty, struct slab, list);
+		list_del(&slab->list);
+		cache->nr_empty--;
+	} else {
+		slab = new_slab(cache);
+		if (!slab)
 			return NULL;
+	}
 
-		sh = st->head;
-		st->head = sh->next;
-		sh->magic = SLAB_MAGIC;
+	list_add(&cache->partial, &slab->list);
 
-		return ((void *)sh + SLAB_HEADER_SIZE);
+	return slab;
+}
+
+static void cache_refill(struct kmem_cache *cache, struct magazine *mag)
+{
+	struct slab *slab;
+	void *obj;
+
+	spin_lock(&cache->lock);
+
+	cache->nr_refill++;
+	while (mag->nr < (MAG_SIZE / 2)) {
+		slab = cache_get_slab(cache);
+		if (!slab)
+			break;
+
+		obj = slab->free;
+		slab->free = *(void **)obj;
+		slab->inuse++;
+		if (slab->free == NULL) {
+			list_del(&slab->list);
+			list_add(&cache->full, &slab->list);
+		}
+
+		mag->objs[mag->nr++] = obj;
+		cache->nr_inuse++;
 	}
 
-	return NULL;
+	spin_unlock(&cache->lock);
 }
 
-static void *malloc_from_slab_heap(size_t size)
+static void cache_free_obj(struct kmem_cache *cache, void *obj)
 {
-	unsigned long slab_size;
-	struct slab_header *sh;
+	struct slab *slab = obj_to_slab(obj);
 
-	if (ULONG(slab_base) >= ULONG(page_base)) {
-		pr_err("no more memory for slab\n");
-		return NULL;
+	ASSERT(slab->magic == SLAB_MAGIC);
+
+	if (slab->free == NULL) {
+		list_del(&slab->list);
+		list_add(&cache->partial, &slab->list);
 	}
 
-	slab_size = ULONG(page_base) - ULONG(slab_base);
-	size += SLAB_HEADER_SIZE;
-	if (slab_size < size) {
-		pr_err("no enough memory for slab 0x%x 0x%x\n",
-				size, slab_size);
-		return NULL;
+	*(void **)obj = slab->free;
+	slab->free = obj;
+	slab->inuse--;
+	cache->nr_inuse--;
+	if (slab->inuse > 0)
+		return;
+
+	/*
+	 * keep some empty slabs for the next allocation, the
+	 * others are returned to the page allocator.
+	 */
+	list_del(&slab->list);
+	if (cache->nr_empty < SLAB_KEEP_EMPTY) {
+		list_add(&cache->empty, &slab->list);
+		cache->nr_empty++;
+	} else {
+		slab->magic = 0;
+		cache->nr_slabs--;
+		free_pages(slab);
 	}
+}
 
-	sh = (struct slab_header *)slab_base;
-	sh->magic = SLAB_MAGIC;
-	sh->size = size - SLAB_HEADER_SIZE;
+/*
+ * return the oldest objects in the magazine to the slabs,
+ * the recently freed ones are kept since they are likely
+ * still in the cache.
+ */
+static void cache_flush(struct kmem_cache *cache,
+		struct magazine *mag, int nr)
+{
+	int i;
 
-	slab_base += size;
+	spin_lock(&cache->lock);
+	cache->nr_flush++;
+	for (i = 0; i < nr; i++)
+		cache_free_obj(cache, mag->objs[i]);
+	spin_unlock(&cache->lock);
 
-	return ((void *)sh + SLAB_HEADER_SIZE);
+	mag->nr -= nr;
+	memmove(&mag->objs[0], &mag->objs[nr], mag->nr * sizeof(void *));
 }
 
-static void free_slab(void *addr)
+static void *cache_alloc(struct kmem_cache *cache)
 {
-	struct slab_header *header;
-	struct slab_type *st;
-	int id;
+	struct magazine *mag;
+	unsigned long flags;
+	void *obj = NULL;
+
+	local_irq_save(flags);
+	mag = &cache->mag[smp_processor_id()];
+	if (mag->nr == 0)
+		cache_refill(cache, mag);
+	if (mag->nr > 0) {
+		obj = mag->objs[--mag->nr];
+		mag->nr_alloc++;
+	}
+	local_irq_restore(flags);
 
-	ASSERT(ULONG(addr) < ULONG(slab_base));
-	header = (struct slab_header *)((unsigned long)addr -
-			SLAB_HEADER_SIZE);
-	ASSERT(header->magic == SLAB_MAGIC);
-	id = hash_id(header->size);
+	return obj;
+}
 
-	list_for_each_entry(st, &slab_hash_table[id], list) {
-		if (st->size != header->size)
-			continue;
+static void cache_free(struct kmem_cache *cache, void *obj)
+{
+	struct magazine *mag;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	mag = &cache->mag[smp_processor_id()];
+	if (mag->nr == MAG_SIZE)
+		cache_flush(cache, mag, MAG_SIZE / 2);
+	mag->objs[mag->nr++] = obj;
+	mag->nr_free++;
+	local_irq_restore(flags);
+}
 
-		header->next = st->head;
-		st->head = header;
-		return;
+#define caller_address()	((unsigned long)__builtin_return_address(0))
+
+#ifdef CONFIG_MM_PROFILE
+/*
+ * in the profile mode each live object of the heap is traced
+ * by a record in a hash table indexed by its address, which
+ * has the call site, the size and the time of the allocation.
+ * the live and total usage of each call site is kept in the
+ * site table. the records are allocated from trace_cache which
+ * is not profiled.
+ */
+#define MM_PROFILE_SITES	256
+#define MM_PROFILE_HASH		1024
+#define MM_PROFILE_FAIL_TOP	8
+
+struct alloc_site {
+	unsigned long caller;
+	unsigned long nr_live;
+	unsigned long live_bytes;
+	unsigned long nr_alloc;
+	unsigned long total_bytes;
+	unsigned long oldest;
+};
+
+/*
+ * size - the size requested by the caller.
+ * slot - the size really used, the object size of the
+ *        cache or the pages of the big allocation.
+ */
+struct alloc_trace {
+	void *obj;
+	struct alloc_site *site;
+	size_t size;
+	size_t slot;
+	unsigned long stamp;
+	struct alloc_trace *next;
+};
+
+static struct kmem_cache trace_cache;
+static struct alloc_site alloc_sites[MM_PROFILE_SITES];
+static struct alloc_trace *alloc_hash[MM_PROFILE_HASH];
+static unsigned long nr_untracked;
+static unsigned long profile_mark;
+static DEFINE_SPIN_LOCK(profile_lock);
+
+static inline struct alloc_trace **trace_bucket(void *obj)
+{
+	return &alloc_hash[(ULONG(obj) >> SLAB_MIN_DATA_SIZE_SHIFT) &
+			(MM_PROFILE_HASH - 1)];
+}
+
+static struct alloc_site *get_alloc_site(unsigned long caller)
+{
+	struct alloc_site *site;
+	int i, idx = (caller >> 2) & (MM_PROFILE_SITES - 1);
+
+	for (i = 0; i < MM_PROFILE_SITES; i++) {
+		site = &alloc_sites[idx];
+		if (site->caller == caller)
+			return site;
+
+		if (site->caller == 0) {
+			site->caller = caller;
+			return site;
+		}
+
+		idx = (idx + 1) & (MM_PROFILE_SITES - 1);
 	}
 
-	/*
-	 * create new slab type and add the new slab header
-	 * to the slab cache.
-	 */
-	st = malloc_from_slab_heap(sizeof(struct slab_type));
-	if (!st) {
-		pr_err("alloc memory for slab type failed\n");
+	return NULL;
+}
+
+static void mm_profile_alloc(void *obj, size_t size, unsigned long caller)
+{
+	struct slab *slab = obj_to_slab(obj);
+	struct alloc_trace *trace, **bucket;
+	struct alloc_site *site;
+	unsigned long flags;
+
+	trace = cache_alloc(&trace_cache);
+	if (trace) {
+		trace->obj = obj;
+		trace->size = size;
+		trace->stamp = NOW();
+		if (slab->cache)
+			trace->slot = slab->cache->size;
+		else
+			trace->slot = slab->pages * PAGE_SIZE - SLAB_HEADER_SIZE;
+	}
+
+	spin_lock_irqsave(&profile_lock, flags);
+
+	site = get_alloc_site(caller);
+	if (!trace || !site) {
+		nr_untracked++;
+		spin_unlock_irqrestore(&profile_lock, flags);
+		if (trace)
+			cache_free(&trace_cache, trace);
 		return;
 	}
 
-	st->size = header->size;
-	st->head = NULL;
-	list_add_tail(&slab_hash_table[id], &st->list);
+	site->nr_live++;
+	site->live_bytes += size;
+	site->nr_alloc++;
+	site->total_bytes += size;
 
-	header->next = st->head;
-	st->head = header;
+	trace->site = site;
+	bucket = trace_bucket(obj);
+	trace->next = *bucket;
+	*bucket = trace;
+
+	spin_unlock_irqrestore(&profile_lock, flags);
 }
 
-static void *__malloc(size_t size)
+static void mm_profile_free(void *obj)
 {
-	void *mem;
+	struct alloc_trace *trace, **pprev;
+	unsigned long flags;
 
-	mem = malloc_from_hash_table(size);
-	if (mem != NULL)
-		return mem;
+	spin_lock_irqsave(&profile_lock, flags);
 
-	return malloc_from_slab_heap(size);
+	pprev = trace_bucket(obj);
+	for (trace = *pprev; trace; pprev = &trace->next, trace = *pprev) {
+		if (trace->obj != obj)
+			continue;
+
+		*pprev = trace->next;
+		trace->site->nr_live--;
+		trace->site->live_bytes -= trace->size;
+		break;
+	}
+
+	spin_unlock_irqrestore(&profile_lock, flags);
+
+	if (trace)
+		cache_free(&trace_cache, trace);
 }
 
-void *malloc(size_t size)
+static void print_alloc_site(unsigned long caller)
 {
-	void *mem;
+	unsigned long offset;
+	char *name;
 
-	ASSERT(size != 0);
-	size = get_slab_alloc_size(size);
+	name = lookup_symbol(caller, &offset);
+	if (name)
+		printf("%s+0x%x\n", name, offset);
+	else
+		printf("0x%p\n", caller);
+}
+
+/*
+ * dump the call sites which hold the most live bytes, the
+ * slot bytes are the memory really used by the live objects,
+ * the difference is the internal fragmentation of the heap.
+ */
+void mm_profile_dump(int top)
+{
+	unsigned long nr_live = 0, live_bytes = 0, slot_bytes = 0;
+	unsigned long now = NOW(), flags;
+	DECLARE_BITMAP(dumped, MM_PROFILE_SITES);
+	struct alloc_site *site, *max;
+	struct alloc_trace *trace;
+	int i, j;
+
+	bitmap_clear(dumped, 0, MM_PROFILE_SITES);
+	spin_lock_irqsave(&profile_lock, flags);
+
+	for (i = 0; i < MM_PROFILE_SITES; i++)
+		alloc_sites[i].oldest = now;
+
+	for (i = 0; i < MM_PROFILE_HASH; i++) {
+		for (trace = alloc_hash[i]; trace; trace = trace->next) {
+			site = trace->site;
+			if (trace->stamp < site->oldest)
+				site->oldest = trace->stamp;
+			nr_live++;
+			live_bytes += trace->size;
+			slot_bytes += trace->slot;
+		}
+	}
+
+	printf("LIVE-OBJS  LIVE(KB)    ALLOCS TOTAL(KB) OLDEST(s) SITE\n");
+	for (i = 0; i < top; i++) {
+		max = NULL;
+		for (j = 0; j < MM_PROFILE_SITES; j++) {
+			site = &alloc_sites[j];
+			if (!site->caller || test_bit(j, dumped))
+				continue;
+			if (!max || (site->live_bytes > max->live_bytes))
+				max = site;
+		}
+
+		if (!max || !max->nr_live)
+			break;
+
+		set_bit(max - alloc_sites, dumped);
+		printf("%9d %9d %9d %9d %9d ", max->nr_live,
+				max->live_bytes >> 10, max->nr_alloc,
+				max->total_bytes >> 10,
+				(now - max->oldest) / 1000000000);
+		print_alloc_site(max->caller);
+	}
+
+	printf("\nlive %d objects, %d bytes requested, %d bytes used, "
+			"%d%% wasted, %d untracked\n",
+			nr_live, live_bytes, slot_bytes, slot_bytes ?
+			(slot_bytes - live_bytes) * 100 / slot_bytes : 0,
+			nr_untracked);
+
+	spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+/*
+ * the objects allocated after the mark and still live, run
+ * mm_profile_mark() before an operation such as creating and
+ * destroying a VM, then the objects left are the leak.
+ */
+void mm_profile_mark(void)
+{
+	profile_mark = NOW();
+}
+
+void mm_profile_leak(int max)
+{
+	unsigned long now = NOW(), flags;
+	struct alloc_trace *trace;
+	int i, nr = 0;
+
+	spin_lock_irqsave(&profile_lock, flags);
+
+	printf("          OBJECT      SIZE   AGE(ms) SITE\n");
+	for (i = 0; i < MM_PROFILE_HASH; i++) {
+		for (trace = alloc_hash[i]; trace; trace = trace->next) {
+			if (trace->stamp < profile_mark)
+				continue;
+
+			if (nr++ < max) {
+				printf("0x%p %9d %9d ", trace->obj, trace->size,
+						(now - trace->stamp) / 1000000);
+				print_alloc_site(trace->site->caller);
+			}
+		}
+	}
+
+	printf("\n%d objects allocated since the mark are live\n", nr);
+
+	spin_unlock_irqrestore(&profile_lock, flags);
+}
+#else
+static inline void mm_profile_alloc(void *obj, size_t size,
+		unsigned long caller) {}
+static inline void mm_profile_free(void *obj) {}
+#endif
+
+static void kmem_cache_init(struct kmem_cache *cache, const char *name,
+		size_t size, void (*ctor)(void *obj))
+{
+	memset(cache, 0, sizeof(struct kmem_cache));
+	strncpy(cache->name, name, MIN(strlen(name), KMEM_CACHE_NAME_SIZE - 1));
+	cache->size = size;
+	cache->nr_objs = (SLAB_SIZE - SLAB_HEADER_SIZE) / size;
+	cache->ctor = ctor;
+	spin_lock_init(&cache->lock);
+	init_list(&cache->partial);
+	init_list(&cache->full);
+	init_list(&cache->empty);
+
+	spin_lock(&kmem_cache_lock);
+	list_add_tail(&kmem_cache_list, &cache->cache_list);
+	spin_unlock(&kmem_cache_lock);
+}
+
+/*
+ * free the empty slabs which are kept for the next allocation,
+ * return how many pages are freed.
+ */
+static unsigned long cache_shrink(struct kmem_cache *cache)
+{
+	unsigned long pages = 0;
+	struct slab *slab;
+
+	spin_lock(&cache->lock);
+	while (!is_list_empty(&cache->empty)) {
+		slab = list_first_entry(&cache->empty, struct slab, list);
+		list_del(&slab->list);
+		cache->nr_empty--;
+		cache->nr_slabs--;
+		slab->magic = 0;
+		pages += slab->pages;
+		free_pages(slab);
+	}
+	spin_unlock(&cache->lock);
+
+	return pages;
+}
+
+/*
+ * called by the kworker of each pcpu, the magazines can only
+ * be drained by its own pcpu, then the slabs which become
+ * empty are freed.
+ */
+void mm_reclaim(void)
+{
+	unsigned long flags, pages = 0;
+	struct kmem_cache *cache;
+	struct magazine *mag;
+	int last;
+
+	spin_lock(&kmem_cache_lock);
+	list_for_each_entry(cache, &kmem_cache_list, cache_list) {
+		local_irq_save(flags);
+		mag = &cache->mag[smp_processor_id()];
+		if (mag->nr)
+			cache_flush(cache, mag, mag->nr);
+		local_irq_restore(flags);
+
+		pages += cache_shrink(cache);
+	}
+	spin_unlock(&kmem_cache_lock);
 
 	spin_lock(&mm_lock);
-	mem =  __malloc(size);
+	nr_reclaim_pages += pages;
+	if (reclaim_pending > 0)
+		reclaim_pending--;
+	last = (reclaim_pending == 0);
 	spin_unlock(&mm_lock);
 
+	pr_info("mm: reclaim %d pages on pcpu%d\n",
+			pages, smp_processor_id());
+
+	if (last)
+		mm_heap_grow();
+}
+
+/*
+ * create a cache for the objects of the same type, the size
+ * is aligned to the pointer size, so the object keeps the
+ * alignment of its type if the size of the type is aligned
+ * to the alignment, which is always true for C types.
+ */
+struct kmem_cache *kmem_cache_create(const char *name,
+		size_t size, void (*ctor)(void *obj))
+{
+	struct kmem_cache *cache;
+
+	size = BALIGN(MAX(size, SLAB_MIN_DATA_SIZE), sizeof(unsigned long));
+	if (size > (SLAB_SIZE - SLAB_HEADER_SIZE)) {
+		pr_err("object of cache %s is too big %d\n", name, size);
+		return NULL;
+	}
+
+	cache = cache_alloc(&cache_cache);
+	if (!cache) {
+		pr_err("no memory for cache %s\n", name);
+		return NULL;
+	}
+
+	kmem_cache_init(cache, name, size, ctor);
+
+	return cache;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+	void *obj;
+
+	obj = cache_alloc(cache);
+	if (!obj) {
+		pr_err("kmem_cache_alloc fail for %s\n", cache->name);
+		return NULL;
+	}
+
+	mm_profile_alloc(obj, cache->size, caller_address());
+
+	if (cache->ctor)
+		cache->ctor(obj);
+
+	return obj;
+}
+
+void *kmem_cache_zalloc(struct kmem_cache *cache)
+{
+	void *obj;
+
+	obj = cache_alloc(cache);
+	if (!obj) {
+		pr_err("kmem_cache_zalloc fail for %s\n", cache->name);
+		return NULL;
+	}
+
+	mm_profile_alloc(obj, cache->size, caller_address());
+
+	memset(obj, 0, cache->size);
+	if (cache->ctor)
+		cache->ctor(obj);
+
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	struct slab *slab;
+
+	ASSERT(obj != NULL);
+	slab = obj_to_slab(obj);
+	ASSERT((slab->magic == SLAB_MAGIC) && (slab->cache == cache));
+
+	mm_profile_free(obj);
+	cache_free(cache, obj);
+}
+
+void dump_slab_info(void)
+{
+	unsigned long nr_alloc, nr_free, nr_cached;
+	struct kmem_cache *cache;
+	int cpu;
+
+	printf(" SIZE  OBJS SLABS   INUSE  CACHED     ALLOC      FREE"
+			"  REFILL   FLUSH NAME\n");
+
+	spin_lock(&kmem_cache_lock);
+	list_for_each_entry(cache, &kmem_cache_list, cache_list) {
+		nr_alloc = nr_free = nr_cached = 0;
+		for (cpu = 0; cpu < NR_CPUS; cpu++) {
+			nr_alloc += cache->mag[cpu].nr_alloc;
+			nr_free += cache->mag[cpu].nr_free;
+			nr_cached += cache->mag[cpu].nr;
+		}
+
+		printf("%5d %5d %5d %7d %7d %9d %9d %7d %7d %s\n",
+				cache->size, cache->nr_objs, cache->nr_slabs,
+				cache->nr_inuse - nr_cached, nr_cached,
+				nr_alloc, nr_free, cache->nr_refill,
+				cache->nr_flush, cache->name);
+	}
+	spin_unlock(&kmem_cache_lock);
+}
+
+static void *malloc_large(size_t size)
+{
+	struct slab *slab;
+	int pages;
+
+	pages = PAGE_NR(size + SLAB_HEADER_SIZE);
+	slab = __get_free_pages(pages, SLAB_PAGES);
+	if (!slab)
+		return NULL;
+
+	slab->magic = SLAB_MAGIC;
+	slab->cache = NULL;
+	slab->free = NULL;
+	slab->inuse = 1;
+	slab->pages = pages;
+
+	return (void *)slab + SLAB_HEADER_SIZE;
+}
+
+static void *__malloc(size_t size, unsigned long caller)
+{
+	void *mem;
+
+	ASSERT(size != 0);
+
+	if (size > SLAB_MAX_DATA_SIZE)
+		mem = malloc_large(size);
+	else
+		mem = cache_alloc(size_to_cache(size));
+
 	if (!mem) {
-		pr_err("malloc fail for 0x%x\n");
+		pr_err("malloc fail for 0x%x\n", size);
 		dump_stack(NULL, NULL);
+#ifdef CONFIG_MM_PROFILE
+		mm_profile_dump(MM_PROFILE_FAIL_TOP);
+#endif
+		return NULL;
 	}
 
+	mm_profile_alloc(mem, size, caller);
+
 	return mem;
 }
 
+void *malloc(size_t size)
+{
+	return __malloc(size, caller_address());
+}
+
 void *zalloc(size_t size)
 {
-	void *addr = malloc(size);
+	void *addr = __malloc(size, caller_address());
 	if (addr)
 		memset(addr, 0, size);
 	return addr;
@@ -212,113 +877,401 @@ void *zalloc(size_t size)
 
 void free(void *addr)
 {
+	struct slab *slab;
+
 	ASSERT(addr != NULL);
-	spin_lock(&mm_lock);
-	free_slab(addr);
-	spin_unlock(&mm_lock);
+	slab = obj_to_slab(addr);
+	ASSERT(slab->magic == SLAB_MAGIC);
+
+	mm_profile_free(addr);
+	if (slab->cache) {
+		cache_free(slab->cache, addr);
+	} else {
+		slab->magic = 0;
+		free_pages(slab);
+	}
 }
 
-static inline void add_used_page(struct page *page)
+#define high_watermark		(low_watermark * 2)
+
+static inline int pfn_in_minos(unsigned long pfn)
 {
-	page->next = used_page_head;
-	used_page_head = page;
+	return ((pfn >= buddy_start_pfn) && (pfn < buddy_end_pfn));
 }
 
-static struct page *find_used_page(void *addr)
+#ifdef CONFIG_VIRT
+static inline struct heap_block **heap_block_bucket(unsigned long pfn)
 {
-	struct page *head = used_page_head;
-	struct page *prev = NULL;
+	return &heap_block_hash[(pfn / HEAP_BLOCK_PAGES) & (HEAP_BLOCK_HASH - 1)];
+}
 
-	while (head) {
-		if (head->pfn == (unsigned long)addr >> PAGE_SHIFT) {
-			if (prev)
-				prev->next = head->next;
-			else
-				used_page_head = head->next;
-			head->next = NULL;
-			return head;
-		}
+static struct heap_block *pfn_to_heap_block(unsigned long pfn)
+{
+	struct heap_block *hb;
+
+	if (pfn_in_minos(pfn))
+		return NULL;
 
-		prev = head;
-		head = head->next;
+	for (hb = *heap_block_bucket(pfn); hb; hb = hb->next) {
+		if ((pfn >= hb->start_pfn) &&
+				(pfn < hb->start_pfn + HEAP_BLOCK_PAGES))
+			return hb;
 	}
 
 	return NULL;
 }
 
-static inline void __free_page(struct page *page)
+static inline void heap_block_account(unsigned long pfn, long nr)
 {
-	page->next = free_page_head;
-	free_page_head = page;
+	struct heap_block *hb = pfn_to_heap_block(pfn);
+
+	if (hb)
+		hb->nr_free += nr;
+}
+#else
+static inline void heap_block_account(unsigned long pfn, long nr) {}
+#endif
+
+static inline struct page *pfn_to_page(unsigned long pfn)
+{
+#ifdef CONFIG_VIRT
+	struct heap_block *hb;
+#endif
+
+	if (pfn_in_minos(pfn))
+		return &page_table[pfn - minos_start_pfn];
+
+#ifdef CONFIG_VIRT
+	hb = pfn_to_heap_block(pfn);
+	if (hb && (pfn != hb->start_pfn))
+		return &hb->pages[pfn - hb->start_pfn];
+#endif
+
+	return NULL;
+}
+
+static inline struct list_head *pfn_to_list(unsigned long pfn)
+{
+	return (struct list_head *)ptov(pfn2phy(pfn));
+}
+
+static inline unsigned long list_to_pfn(struct list_head *list)
+{
+	return phy2pfn(vtop(list));
+}
+
+static void buddy_add_free(unsigned long pfn, int order)
+{
+	list_add(&free_area[order].list, pfn_to_list(pfn));
+	free_area[order].nr_free++;
+	pfn_to_page(pfn)->order = order + 1;
+	heap_block_account(pfn, 1L << order);
+}
+
+static void buddy_del_free(unsigned long pfn, int order)
+{
+	list_del(pfn_to_list(pfn));
+	free_area[order].nr_free--;
+	pfn_to_page(pfn)->order = 0;
+	heap_block_account(pfn, -(1L << order));
+}
+
+static inline int buddy_is_free(unsigned long pfn, int order)
+{
+	struct page *page;
+
+	if (pfn_in_minos(pfn) &&
+			((pfn + (1UL << order)) > buddy_end_pfn))
+		return 0;
+
+	page = pfn_to_page(pfn);
+
+	return (page && (page->order == (order + 1)));
+}
+
+/*
+ * merge the block with its buddy as long as the buddy is
+ * also free and has the same order.
+ */
+static void buddy_free_block(unsigned long pfn, int order)
+{
+	unsigned long buddy;
+
+	while (order < BUDDY_MAX_ORDER) {
+		buddy = pfn ^ (1UL << order);
+		if (!buddy_is_free(buddy, order))
+			break;
+
+		buddy_del_free(buddy, order);
+		pfn &= ~(1UL << order);
+		order++;
+	}
+
+	buddy_add_free(pfn, order);
+}
+
+/*
+ * free a run of pages which may not be a power of two, split
+ * it to the biggest aligned blocks.
+ */
+static void buddy_free_range(unsigned long pfn, unsigned long nr)
+{
+	int order;
+
+	nr_free_pages += nr;
+
+	while (nr) {
+		order = pfn ? __ffs(pfn) : BUDDY_MAX_ORDER;
+		order = MIN(order, BUDDY_MAX_ORDER);
+		while ((1UL << order) > nr)
+			order--;
+
+		buddy_free_block(pfn, order);
+		pfn += 1UL << order;
+		nr -= 1UL << order;
+	}
+}
+
+/*
+ * allocate a block which is big enough for the pages and the
+ * align, split the bigger block if needed, the tail pages which
+ * are not used are given back. return 0 if no memory.
+ */
+static unsigned long buddy_alloc(unsigned long nr, unsigned long align)
+{
+	struct free_area *area;
+	unsigned long pfn;
+	int order = 0, k;
+
+	while (((1UL << order) < nr) || ((1UL << order) < align))
+		order++;
+
+	if (order > BUDDY_MAX_ORDER)
+		return 0;
+
+	for (k = order; k <= BUDDY_MAX_ORDER; k++) {
+		area = &free_area[k];
+		if (!is_list_empty(&area->list))
+			break;
+	}
+
+	if (k > BUDDY_MAX_ORDER)
+		return 0;
+
+	pfn = list_to_pfn(area->list.next);
+	buddy_del_free(pfn, k);
+
+	while (k > order) {
+		k--;
+		buddy_add_free(pfn + (1UL << k), k);
+	}
+
+	nr_free_pages -= 1UL << order;
+	if ((1UL << order) > nr)
+		buddy_free_range(pfn + nr, (1UL << order) - nr);
+
+	return pfn;
 }
 
 void free_pages(void *addr)
 {
+	unsigned long pfn = phy2pfn(vtop(addr));
 	struct page *page;
+	int shrink = 0;
+#ifdef CONFIG_VIRT
+	struct heap_block *hb;
+#endif
 
 	ASSERT(IS_PAGE_ALIGN(addr) || (addr != NULL));
 	spin_lock(&mm_lock);
-	page = find_used_page(addr);
-	if (page)
-		__free_page(page);
-	else
+
+	page = pfn_to_page(pfn);
+	if (page && (page->flags & PAGE_FLAGS_USED)) {
+		page->flags = 0;
+		nr_used_allocs--;
+		buddy_free_range(pfn, page->cnt);
+	} else {
 		pr_err("%s: free wrong page 0x%x\n", __func__, addr);
+	}
+
+#ifdef CONFIG_VIRT
+	hb = pfn_to_heap_block(pfn);
+	if (hb && (hb->nr_free == HEAP_BLOCK_PAGES - 1) &&
+			!heap_shrink_pending && get_pcpu()->kworker &&
+			(nr_free_pages >= high_watermark + HEAP_BLOCK_PAGES)) {
+		heap_shrink_pending = 1;
+		shrink = 1;
+	}
+#endif
+
 	spin_unlock(&mm_lock);
+
+	/*
+	 * the heap block is returned by the kworker, since the
+	 * caller may hold the lock which the unmapping needs.
+	 */
+	if (shrink)
+		flag_set(&get_pcpu()->kworker_flag, KWORKER_HEAP_SHRINK);
 }
 
-static struct page *alloc_new_pages(int pages, unsigned long align)
+#ifdef CONFIG_VIRT
+static int heap_grow_one(void)
 {
-	unsigned long tmp = (unsigned long)page_base;
-	struct page *recycle = NULL;
-	unsigned long base, rbase;
-	struct page *page;
+	struct heap_block *hb, **bucket;
+	unsigned long base;
+
+	base = vmm_borrow_memblock();
+	if (!base)
+		return -ENOMEM;
+
+	if (create_host_mapping(ptov(base), base, MEM_BLOCK_SIZE,
+				VM_NORMAL | VM_RW | VM_HUGE)) {
+		pr_err("mapping heap block 0x%x failed\n", base);
+		vmm_return_memblock(base);
+		return -EFAULT;
+	}
 
-	base = tmp - pages * PAGE_SIZE;
-	base = ALIGN(base, align);
-	if (base < (unsigned long)slab_base) {
-		pr_err("no more pages %d 0x%x\n", pages, align);
-		return NULL;
+	hb = (struct heap_block *)ptov(base);
+	memset(hb, 0, sizeof(struct heap_block));
+	hb->start_pfn = phy2pfn(base);
+
+	spin_lock(&mm_lock);
+	bucket = heap_block_bucket(hb->start_pfn);
+	hb->next = *bucket;
+	*bucket = hb;
+	list_add_tail(&heap_block_list, &hb->list);
+	nr_heap_blocks++;
+	nr_total_pages += HEAP_BLOCK_PAGES - 1;
+	buddy_free_range(hb->start_pfn + 1, HEAP_BLOCK_PAGES - 1);
+	spin_unlock(&mm_lock);
+
+	return 0;
+}
+
+/*
+ * called when the reclaim pass is done on all the pcpus, this
+ * is in the kworker context and no lock is held, so the memory
+ * block can be mapped here.
+ */
+static void mm_heap_grow(void)
+{
+	unsigned long nr_free;
+	int nr = 0;
+
+	for (;;) {
+		spin_lock(&mm_lock);
+		nr_free = nr_free_pages;
+		spin_unlock(&mm_lock);
+
+		if ((nr_free >= high_watermark) || heap_grow_one())
+			break;
+		nr++;
 	}
 
-	rbase = base + pages * PAGE_SIZE;
-	if (rbase != tmp) {
-		recycle = __malloc(sizeof(struct page));
-		if (!recycle) {
-			pr_err("can not allocate memory for page\n");
-			return NULL;
-		}
+	if (nr)
+		pr_notice("mm: borrow %d memory blocks for heap\n", nr);
+}
 
-		recycle->pfn = rbase >> PAGE_SHIFT;
-		recycle->flags = 0;
-		recycle->align = 1;
-		recycle->cnt = (tmp - rbase) >> PAGE_SHIFT;
-		recycle->next = NULL;
-		__free_page(recycle);
+static void heap_block_detach(struct heap_block *hb)
+{
+	struct heap_block **pprev;
+	unsigned long pfn;
+	int order;
+
+	pfn = hb->start_pfn + 1;
+	while (pfn < hb->start_pfn + HEAP_BLOCK_PAGES) {
+		order = hb->pages[pfn - hb->start_pfn].order - 1;
+		ASSERT(order >= 0);
+		buddy_del_free(pfn, order);
+		pfn += 1UL << order;
 	}
 
-	page = __malloc(sizeof(struct page));
-	if (!page) {
-		pr_err("can not allocate memory for page\n");
-		if (recycle)
-			free_slab(recycle);
-		return NULL;
+	pprev = heap_block_bucket(hb->start_pfn);
+	while (*pprev != hb)
+		pprev = &(*pprev)->next;
+	*pprev = hb->next;
+
+	list_del(&hb->list);
+	nr_heap_blocks--;
+	nr_free_pages -= HEAP_BLOCK_PAGES - 1;
+	nr_total_pages -= HEAP_BLOCK_PAGES - 1;
+}
+
+void mm_heap_shrink(void)
+{
+	struct heap_block *hb, *tmp, *head = NULL;
+	unsigned long base;
+	int nr = 0;
+
+	spin_lock(&mm_lock);
+	list_for_each_entry_safe(hb, tmp, &heap_block_list, list) {
+		if (nr_free_pages < high_watermark + HEAP_BLOCK_PAGES)
+			break;
+		if (hb->nr_free != HEAP_BLOCK_PAGES - 1)
+			continue;
+
+		heap_block_detach(hb);
+		hb->next = head;
+		head = hb;
 	}
+	heap_shrink_pending = 0;
+	spin_unlock(&mm_lock);
 
-	page->pfn = base >> PAGE_SHIFT;
-	page->flags = 0;
-	page->cnt = pages;
-	page->align = align >> PAGE_SHIFT;
-	page->next = NULL;
+	while (head) {
+		hb = head;
+		head = hb->next;
+		base = pfn2phy(hb->start_pfn);
+
+		/*
+		 * the block goes back to the guest memory pool, do
+		 * not leak the hypervisor data to the guest.
+		 */
+		memset((void *)ptov(base), 0, MEM_BLOCK_SIZE);
+		destroy_host_mapping(ptov(base), MEM_BLOCK_SIZE);
+		vmm_return_memblock(base);
+		nr++;
+	}
 
-	page_base = (void *)base;
+	if (nr)
+		pr_notice("mm: return %d memory blocks from heap\n", nr);
+}
+#else
+static void mm_heap_grow(void) {}
+void mm_heap_shrink(void) {}
+#endif
+
+static void mm_request_reclaim(void)
+{
+	struct pcpu *pcpu;
+	int cpu, nr = 0;
+
+	spin_lock(&mm_lock);
+	if (reclaim_pending) {
+		spin_unlock(&mm_lock);
+		return;
+	}
 
-	return page;
+	for_each_online_cpu(cpu) {
+		if (pcpus[cpu].kworker)
+			nr++;
+	}
+	reclaim_pending = nr;
+	if (nr)
+		nr_reclaim++;
+	spin_unlock(&mm_lock);
+
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		if (pcpu->kworker)
+			flag_set(&pcpu->kworker_flag, KWORKER_MM_RECLAIM);
+	}
 }
 
-static struct page *__alloc_pages(int pages, int align)
+static unsigned long __alloc_pages(int pages, int align)
 {
-	struct page *page = NULL;
-	struct page *tmp, *prev = NULL;
+	struct page *page;
+	unsigned long pfn;
+	int reclaim = 0;
 
 	switch (align) {
 	case 1:
@@ -328,69 +1281,126 @@ static struct page *__alloc_pages(int pages, int align)
 		break;
 	default:
 		pr_err("%s:unsupport align value %d\n", __func__, align);
-		return NULL;
+		return 0;
 	}
 
 	spin_lock(&mm_lock);
-	tmp = free_page_head;
 
-	/*
-	 * try to get the free page from the free list.
-	 */
-	while (tmp) {
-		if ((tmp->cnt == pages) && (tmp->align == align)) {
-			page = tmp;
-			break;
-		}
-
-		prev = tmp;
-		tmp = tmp->next;
-	}
-
-	if (!page) {
-		page = alloc_new_pages(pages, PAGE_SIZE * align);
+	pfn = buddy_alloc(pages, align);
+	if (!pfn) {
+		pr_err("no more pages %d 0x%x\n", pages, align);
 	} else {
-		if (prev != NULL) {
-			prev->next = page->next;
-			page->next = NULL;
-		} else {
-			free_page_head = NULL;
-		}
+		page = pfn_to_page(pfn);
+		page->flags = PAGE_FLAGS_USED;
+		page->cnt = pages;
+		nr_used_allocs++;
 	}
 
-	add_used_page(page);
+	if ((nr_free_pages < low_watermark) && !reclaim_pending)
+		reclaim = 1;
+
 	spin_unlock(&mm_lock);
 
-	return page;
+	if (reclaim)
+		mm_request_reclaim();
+
+	return pfn;
 }
 
 void *__get_free_pages(int pages, int align)
 {
-	struct page *page = NULL;
+	unsigned long pfn;
 
-	page = __alloc_pages(pages, align);
-	if (!page)
+	pfn = __alloc_pages(pages, align);
+	if (!pfn)
 		return NULL;
 
-	return (void *)ptov(pfn2phy(page->pfn));
+	return (void *)ptov(pfn2phy(pfn));
 }
 
 static void slab_init(void)
 {
-	int i;
+	char name[KMEM_CACHE_NAME_SIZE];
+	int i, size, class = 0;
 
 	pr_notice("slab memory allocator init ...\n");
-	for (i = 0; i < HASH_TABLE_SIZE; i++)
-		init_list(&slab_hash_table[i]);
+
+	kmem_cache_init(&cache_cache, "kmem_cache",
+			sizeof(struct kmem_cache), NULL);
+
+	for (i = 0; i < NR_SIZE_CLASSES; i++) {
+		sprintf(name, "size-%d", size_class[i]);
+		kmem_cache_init(&size_caches[i], name, size_class[i], NULL);
+	}
+
+#ifdef CONFIG_MM_PROFILE
+	kmem_cache_init(&trace_cache, "alloc_trace",
+			sizeof(struct alloc_trace), NULL);
+#endif
+
+	for (i = 0; i <= (SLAB_MAX_DATA_SIZE >> SLAB_MIN_DATA_SIZE_SHIFT); i++) {
+		size = i << SLAB_MIN_DATA_SIZE_SHIFT;
+		while (size_class[class] < size)
+			class++;
+		size_class_index[i] = class;
+	}
 }
 
 static void memory_init(void)
 {
-	slab_base = (void *)BALIGN(ptov(minos_end), 16);
-	page_base = (void *)ptov(minos_start + CONFIG_MINOS_RAM_SIZE);
-	pr_notice("MEM slab 0x%x page 0x%x\n",
-			(unsigned long)slab_base, (unsigned long)page_base);
-	ASSERT(page_base > slab_base);
+	unsigned long start = PAGE_BALIGN(vtop(minos_end));
+	unsigned long end = vtop(minos_start) + CONFIG_MINOS_RAM_SIZE;
+	int i;
+
+	ASSERT(end > start);
+
+	for (i = 0; i <= BUDDY_MAX_ORDER; i++) {
+		init_list(&free_area[i].list);
+		free_area[i].nr_free = 0;
+	}
+
+	minos_start_pfn = phy2pfn(vtop(minos_start));
+	buddy_start_pfn = phy2pfn(start);
+	buddy_end_pfn = phy2pfn(end);
+	nr_total_pages = buddy_end_pfn - buddy_start_pfn;
+	low_watermark = nr_total_pages * CONFIG_MM_LOW_WATERMARK / 100;
+	buddy_free_range(buddy_start_pfn, nr_total_pages);
+
+	pr_notice("MEM page 0x%x ---> 0x%x %d pages\n",
+			ptov(start), ptov(end), nr_total_pages);
+}
+
+/*
+ * the fragmentation is how much of the free memory can not
+ * be used by an allocation of the biggest free block.
+ */
+void dump_page_info(void)
+{
+	unsigned long largest = 0;
+	int i;
+
+	spin_lock(&mm_lock);
+
+	printf("ORDER    BLOCKS     PAGES\n");
+	for (i = 0; i <= BUDDY_MAX_ORDER; i++) {
+		printf("%5d %9ld %9ld\n", i, free_area[i].nr_free,
+				free_area[i].nr_free << i);
+		if (free_area[i].nr_free)
+			largest = 1UL << i;
+	}
+
+	printf("\ntotal %ld pages, free %ld pages, %ld allocations\n",
+			nr_total_pages, nr_free_pages, nr_used_allocs);
+	printf("largest free block %ld pages, fragmentation %ld%%\n",
+			largest, nr_free_pages ?
+			100 - (largest * 100 / nr_free_pages) : 0);
+	printf("low watermark %ld pages, reclaim %ld times %ld pages\n",
+			low_watermark, nr_reclaim, nr_reclaim_pages);
+#ifdef CONFIG_VIRT
+	printf("%ld memory blocks borrowed for heap\n", nr_heap_blocks);
+#endif
+
+	spin_unlock(&mm_lock);
 }
 
 static void memory_region_init(void)
@@ -31,6 +31,33 @@
 
 DEFINE_PER_CPU(struct pcpu *, pcpu);
 
+/*
+ * the run time load of a pcpu will decay by half for
+ * each period.
+ */
+#define PCPU_LOAD_PERIOD	MILLISECS(32)
+
+#define DL_BW_LIMIT	((CONFIG_SCHED_DL_BW_PERCENT * DL_BW_UNIT) / 100)
+
+static DEFINE_SPIN_LOCK(dl_bw_lock);
+
+/*
+ * the credit is given every period, and the running task
+ * is charged every tick.
+ */
+#define CREDIT_PERIOD		MILLISECS(CONFIG_SCHED_CREDIT_PERIOD)
+#define CREDIT_TICKS_PER_PERIOD	3
+#define CREDIT_TICK		(CREDIT_PERIOD / CREDIT_TICKS_PER_PERIOD)
+
+static DEFINE_SPIN_LOCK(credit_lock);
+
+#define GANG_SLOT		MILLISECS(CONFIG_SCHED_GANG_SLOT)
+#define SCHED_MAX_GANG		64
+
+static DEFINE_SPIN_LOCK(gang_lock);
+static DECLARE_BITMAP(gang_map, SCHED_MAX_GANG);
+static int nr_gangs;
+
 extern struct task *os_task_table[OS_NR_TASKS];
 
 #define sched_check()								\
@@ -62,14 +89,54 @@ static inline void sched_update_sched_timer(void)
 
 	/*
 	 * enable the sched timer if there are more than one
-	 * ready task on the same prio.
+	 * ready task on the same prio, the deadline tasks are
+	 * not round robin, they are sorted by the deadline.
 	 */
-	if ((pcpu->tasks_in_prio[task->prio] > 1))
+	if ((task->prio != OS_PRIO_DEADLINE) &&
+			(pcpu->tasks_in_prio[task->prio] > 1))
 		setup_and_start_timer(&pcpu->sched_timer, MILLISECS(task->run_time));
 	else
 		stop_timer(&pcpu->sched_timer);
 }
 
+/*
+ * the task which has no affinity is also counted in the
+ * nr_movable of the pcpu, only these tasks can be moved
+ * to other pcpu by the load balance.
+ */
+static inline void pcpu_ready_inc(struct pcpu *pcpu, struct task *task)
+{
+	atomic_inc(&pcpu->nr_ready);
+	if (task->affinity == TASK_AFF_ANY)
+		atomic_inc(&pcpu->nr_movable);
+}
+
+static inline void pcpu_ready_dec(struct pcpu *pcpu, struct task *task)
+{
+	atomic_dec(&pcpu->nr_ready);
+	if (task->affinity == TASK_AFF_ANY)
+		atomic_dec(&pcpu->nr_movable);
+}
+
+/*
+ * the ready list of the deadline prio is sorted by the
+ * absolute deadline, the first one is the next to run.
+ */
+static void dl_insert_ready_list(struct pcpu *pcpu, struct task *task)
+{
+	struct list_head *head = &pcpu->ready_list[OS_PRIO_DEADLINE];
+	struct task *tmp;
+
+	list_for_each_entry(tmp, head, state_list) {
+		if (task->dl.abs_deadline < tmp->dl.abs_deadline) {
+			list_insert_before(&tmp->state_list, &task->state_list);
+			return;
+		}
+	}
+
+	list_add_tail(head, &task->state_list);
+}
+
 static void add_task_to_ready_list(struct pcpu *pcpu,
 		struct task *task, int preempt)
 {
@@ -83,7 +150,12 @@ static void add_task_to_ready_list(struct pcpu *pcpu,
 	ASSERT(task->state_list.next == NULL);
 	pcpu->tasks_in_prio[task->prio]++;
 
-	if (current->prio == task->prio) {
+	if (task_is_dl(task)) {
+		dl_insert_ready_list(pcpu, task);
+		if (task_is_dl(current) &&
+				(task->dl.abs_deadline < current->dl.abs_deadline))
+			preempt = 1;
+	} else if (current->prio == task->prio) {
 		list_insert_before(&current->state_list, &task->state_list);
 		if (pcpu->tasks_in_prio[task->prio] == 2)
 			sched_update_sched_timer();
@@ -92,7 +164,7 @@ static void add_task_to_ready_list(struct pcpu *pcpu,
 	}
 
 	mb();
-	pcpu->local_rdy_grp |= BIT(task->prio);
+	pcpu_set_prio_ready(pcpu, task->prio);
 
 	if (preempt || current->prio > task->prio)
 		set_need_resched();
@@ -104,10 +176,11 @@ static void remove_task_from_ready_list(struct pcpu *pcpu, struct task *task)
 
 	list_del(&task->state_list);
 	if (is_list_empty(&pcpu->ready_list[task->prio]))
-		pcpu->local_rdy_grp &= ~BIT(task->prio);
+		pcpu_clear_prio_ready(pcpu, task->prio);
 	mb();
 
 	pcpu->tasks_in_prio[task->prio]--;
+	pcpu_ready_dec(pcpu, task);
 
 	/*
 	 * check whether need to stop the sched timer.
@@ -127,12 +200,85 @@ void pcpu_irqwork(int pcpu_id)
 	send_sgi(CONFIG_MINOS_IRQWORK_IRQ, pcpu_id);
 }
 
-static int select_task_run_cpu(void)
+static unsigned long __pcpu_recent_load(struct pcpu *pcpu, unsigned long now)
 {
+	unsigned long periods;
+
+	if (now <= pcpu->load_stamp)
+		return pcpu->load_ns;
+
+	periods = (now - pcpu->load_stamp) / PCPU_LOAD_PERIOD;
+	if (periods >= BITS_PER_LONG)
+		return 0;
+
+	return pcpu->load_ns >> periods;
+}
+
+unsigned long pcpu_recent_load(int cpu)
+{
+	return __pcpu_recent_load(&pcpus[cpu], NOW());
+}
+
+int pcpu_nr_ready(int cpu)
+{
+	return atomic_read(&pcpus[cpu].nr_ready);
+}
+
+static void pcpu_update_load(struct pcpu *pcpu,
+		unsigned long now, unsigned long delta)
+{
+	unsigned long periods;
+
+	periods = (now - pcpu->load_stamp) / PCPU_LOAD_PERIOD;
+	if (periods) {
+		pcpu->load_ns = __pcpu_recent_load(pcpu, now);
+		if (periods >= BITS_PER_LONG)
+			pcpu->load_stamp = now;
+		else
+			pcpu->load_stamp += periods * PCPU_LOAD_PERIOD;
+	}
+
+	pcpu->load_ns += delta;
+}
+
+static int select_task_run_cpu(struct task *task)
+{
+	unsigned long now = NOW(), load, best_load = ~0UL;
+	int cpu, nr, best_nr = INT_MAX, best = -1;
+	struct pcpu *pcpu;
+
 	/*
-	 * TBD
+	 * if the last cpu of this task is idle now, run the task
+	 * on it again, the cache of this cpu may still hot.
 	 */
-	return (NR_CPUS - 1);
+	cpu = task->last_cpu;
+	if ((cpu >= 0) && (cpu < NR_CPUS) &&
+			(pcpus[cpu].state != PCPU_STATE_OFFLINE) &&
+			!pcpus[cpu].nohz_full &&
+			(atomic_read(&pcpus[cpu].nr_ready) == 0))
+		return cpu;
+
+	/*
+	 * otherwise select the pcpu which has the minimum ready
+	 * tasks, the idle pcpu is always be prefered, if more
+	 * than one pcpu has the same ready tasks, select the
+	 * one which has the minimum recent run time.
+	 */
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		if ((pcpu->state == PCPU_STATE_OFFLINE) || pcpu->nohz_full)
+			continue;
+
+		nr = atomic_read(&pcpu->nr_ready);
+		load = __pcpu_recent_load(pcpu, now);
+		if ((nr < best_nr) || ((nr == best_nr) && (load < best_load))) {
+			best = cpu;
+			best_nr = nr;
+			best_load = load;
+		}
+	}
+
+	return (best == -1) ? HOUSEKEEPING_CPU : best;
 }
 
 static void percpu_task_ready(struct pcpu *pcpu, struct task *task, int preempt)
@@ -144,40 +290,150 @@ static void percpu_task_ready(struct pcpu *pcpu, struct task *task, int preempt)
 	local_irq_restore(flags);
 }
 
+/*
+ * push the task to the wake_list of the pcpu, return 1 if
+ * the wake_list is empty before.
+ */
+static int wake_list_push(struct pcpu *pcpu, struct task *task)
+{
+	struct task *head, *old;
+
+	head = pcpu->wake_list;
+	for (;;) {
+		task->wake_next = head;
+		old = cmpxchg(&pcpu->wake_list, head, task);
+		if (old == head)
+			break;
+		head = old;
+	}
+
+	return (head == NULL);
+}
+
+/*
+ * take all the tasks in the wake_list, and return them in
+ * the order they were pushed.
+ */
+static struct task *wake_list_take_all(struct pcpu *pcpu)
+{
+	struct task *head, *next, *prev = NULL;
+
+	head = xchg(&pcpu->wake_list, NULL);
+	while (head) {
+		next = head->wake_next;
+		head->wake_next = prev;
+		prev = head;
+		head = next;
+	}
+
+	return prev;
+}
+
 static inline void smp_percpu_task_ready(struct pcpu *pcpu,
 		struct task *task, int preempt)
 {
-	unsigned long flags;
+	struct pcpu *self = get_pcpu();
 
 	if (preempt)
 		task_set_resched(task);
 
 	ASSERT(task->state_list.next == NULL);
-	spin_lock_irqsave(&pcpu->lock, flags);
-	list_add_tail(&pcpu->new_list, &task->state_list);
-	spin_unlock_irqrestore(&pcpu->lock, flags);
+	self->nr_remote_wake++;
 
-	pcpu_irqwork(pcpu->pcpu_id);
+	/*
+	 * if the wake_list is not empty, the irqwork has already
+	 * been sent to the pcpu and it has not taken the list
+	 * yet, no need to send it again unless the pcpu is idle.
+	 */
+	if (!wake_list_push(pcpu, task) && (pcpu->state != PCPU_STATE_IDLE))
+		return;
+
+	if (self->wake_batch) {
+		cpumask_set_cpu(pcpu->pcpu_id, &self->wake_kick);
+	} else {
+		self->nr_wake_ipi++;
+		pcpu_irqwork(pcpu->pcpu_id);
+	}
 }
 
-int task_ready(struct task *task, int preempt)
+void wakeup_batch_begin(void)
+{
+	preempt_disable();
+	get_pcpu()->wake_batch++;
+}
+
+void wakeup_batch_end(void)
+{
+	struct pcpu *pcpu = get_pcpu();
+	unsigned long flags;
+	int cpu;
+
+	/*
+	 * irq may also queue the task to other pcpu and update
+	 * the wake_kick, disable the irq here.
+	 */
+	local_irq_save(flags);
+	if (--pcpu->wake_batch == 0) {
+		for_each_cpu(cpu, &pcpu->wake_kick) {
+			cpumask_clear_cpu(cpu, &pcpu->wake_kick);
+			pcpu->nr_wake_ipi++;
+			pcpu_irqwork(cpu);
+		}
+	}
+	local_irq_restore(flags);
+
+	preempt_enable();
+}
+
+/*
+ * CBS wakeup rule, start a new period if the deadline is
+ * passed or the left budget can not be used before the
+ * deadline without exceeding the reserved bandwidth, if
+ * the budget is used up, postpone the deadline.
+ */
+static void dl_task_wakeup(struct task *task, unsigned long now)
+{
+	struct task_dl *dl = &task->dl;
+
+	if ((now >= dl->abs_deadline) || ((dl->budget > 0) &&
+			((unsigned long)dl->budget * dl->period >
+			 (dl->abs_deadline - now) * dl->runtime))) {
+		dl->abs_deadline = now + dl->deadline;
+		dl->budget = dl->runtime;
+	} else if (dl->budget <= 0) {
+		dl->abs_deadline += dl->period;
+		dl->budget = dl->runtime;
+	}
+}
+
+static int __task_ready(struct task *task, int preempt, int defer)
 {
 	struct pcpu *pcpu, *tpcpu;
+	unsigned long now = NOW();
 
 	preempt_disable();
 
+	if (task_is_dl(task))
+		dl_task_wakeup(task, now);
+
+	task->stat.ready_stamp = now;
+	task->stat.woken = 1;
+
 	task->cpu = task->affinity;
 	if (task->cpu == -1)
-		task->cpu = select_task_run_cpu();
+		task->cpu = select_task_run_cpu(task);
+	pcpu_ready_inc(&pcpus[task->cpu], task);
 
 	/*
 	 * if the task is a precpu task and the cpu is not
 	 * the cpu which this task affinity to then put this
-	 * cpu to the new_list of the pcpu and send a resched
-	 * interrupt to the pcpu
+	 * cpu to the wake_list of the pcpu and send a irqwork
+	 * interrupt to the pcpu, the deferred one always use the
+	 * wake_list even the target is this pcpu, since the pcpu
+	 * is in the middle of the context switch.
 	 */
 	pcpu = get_pcpu();
-	if (pcpu->pcpu_id != task->cpu) {
+	if (defer || (pcpu->pcpu_id != task->cpu)) {
 		tpcpu = get_per_cpu(pcpu, task->cpu);
 		smp_percpu_task_ready(tpcpu, task, preempt);
 	} else {
@@ -189,6 +445,596 @@ int task_ready(struct task *task, int preempt)
 	return 0;
 }
 
+int task_ready(struct task *task, int preempt)
+{
+	return __task_ready(task, preempt, 0);
+}
+
+static struct task *find_migratable_task(struct pcpu *pcpu)
+{
+	struct task *task;
+	int prio;
+
+	/*
+	 * find the highest prio task which is ready but not
+	 * running on this pcpu and do not have affinity.
+	 */
+	for (prio = 0; prio < OS_PRIO_IDLE; prio++) {
+		if (!pcpu_prio_ready(pcpu, prio))
+			continue;
+
+		list_for_each_entry(task, &pcpu->ready_list[prio], state_list) {
+			if ((task == current) || task_is_idle(task))
+				continue;
+			if ((task->affinity == TASK_AFF_ANY) &&
+					(task->state == TASK_STATE_READY))
+				return task;
+		}
+	}
+
+	return NULL;
+}
+
+static void pcpu_push_task(struct pcpu *pcpu, int cpu)
+{
+	struct pcpu *tpcpu = &pcpus[cpu];
+	struct task *task;
+
+	if ((cpu == pcpu->pcpu_id) || (tpcpu->state == PCPU_STATE_OFFLINE) ||
+			tpcpu->nohz_full)
+		return;
+
+	/*
+	 * the load may changed after the request is sent, only
+	 * push the task when the target pcpu is still lighter
+	 * after this task is moved.
+	 */
+	if ((atomic_read(&tpcpu->nr_ready) + 1) >=
+			atomic_read(&pcpu->nr_ready))
+		return;
+
+	if (atomic_read(&pcpu->nr_movable) == 0)
+		return;
+
+	task = find_migratable_task(pcpu);
+	if (!task)
+		return;
+
+	remove_task_from_ready_list(pcpu, task);
+	task->cpu = cpu;
+	task->migrate_cnt++;
+	pcpu->nr_migrate_out++;
+	atomic_inc(&tpcpu->nr_migrate_in);
+	pcpu_ready_inc(tpcpu, task);
+
+	smp_percpu_task_ready(tpcpu, task, 0);
+}
+
+static int find_busiest_pcpu(int self)
+{
+	int cpu, nr, busiest = -1, max = 1;
+
+	for_each_online_cpu(cpu) {
+		if ((cpu == self) || (pcpus[cpu].state == PCPU_STATE_OFFLINE) ||
+				pcpus[cpu].nohz_full)
+			continue;
+
+		/*
+		 * the pinned task can not be pulled, do not send
+		 * the request to the pcpu which has nothing to move.
+		 */
+		if (atomic_read(&pcpus[cpu].nr_movable) == 0)
+			continue;
+
+		nr = atomic_read(&pcpus[cpu].nr_ready);
+		if (nr > max) {
+			max = nr;
+			busiest = cpu;
+		}
+	}
+
+	return busiest;
+}
+
+static void request_pull_task(int from, int to)
+{
+	struct pcpu *pcpu = &pcpus[from];
+
+	/*
+	 * only one request can be pending on the pcpu, the
+	 * pcpu which has the request will handle it in its
+	 * irqwork handler, so the ready list of each pcpu is
+	 * only changed by itself.
+	 */
+	if (cmpxchg(&pcpu->steal_cpu, -1, to) == -1)
+		pcpu_irqwork(from);
+}
+
+void sched_idle_balance(void)
+{
+	struct pcpu *pcpu = get_pcpu();
+	int busiest;
+
+	if (pcpu->nohz_full)
+		return;
+
+	busiest = find_busiest_pcpu(pcpu->pcpu_id);
+	if (busiest != -1)
+		request_pull_task(busiest, pcpu->pcpu_id);
+}
+
+#if CONFIG_SCHED_BALANCE_PERIOD > 0
+static struct timer balance_timer;
+
+static void sched_balance_handler(unsigned long data)
+{
+	int cpu, nr, idlest = -1, busiest = -1;
+	int min = INT_MAX, max = 0;
+
+	for_each_online_cpu(cpu) {
+		if ((pcpus[cpu].state == PCPU_STATE_OFFLINE) ||
+				pcpus[cpu].nohz_full)
+			continue;
+
+		nr = atomic_read(&pcpus[cpu].nr_ready);
+		if (nr < min) {
+			min = nr;
+			idlest = cpu;
+		}
+		if (atomic_read(&pcpus[cpu].nr_movable) == 0)
+			continue;
+		if (nr > max) {
+			max = nr;
+			busiest = cpu;
+		}
+	}
+
+	if ((idlest != -1) && (busiest != -1) && ((max - min) >= 2))
+		request_pull_task(busiest, idlest);
+
+	setup_and_start_timer(&balance_timer,
+			MILLISECS(CONFIG_SCHED_BALANCE_PERIOD));
+}
+#endif
+
+static void dl_timer_handler(unsigned long data)
+{
+	struct task *task = (struct task *)data;
+
+	if (task->throttled) {
+		task->throttled = 0;
+		task_ready(task, 1);
+	} else if (task == current) {
+		task->throttled = 1;
+		set_need_resched();
+	}
+}
+
+/*
+ * make the task a deadline task, the task must be pinned
+ * to one pcpu and not started yet, the bandwidth of all
+ * the deadline tasks on one pcpu can not exceed the limit.
+ */
+int task_set_deadline(struct task *task, unsigned long runtime,
+		unsigned long deadline, unsigned long period)
+{
+	struct pcpu *pcpu;
+	unsigned long bw;
+
+	if ((runtime == 0) || (runtime > deadline) || (deadline > period))
+		return -EINVAL;
+
+	if ((task->affinity == TASK_AFF_ANY) || task_is_dl(task) ||
+			(task->state != TASK_STATE_SUSPEND))
+		return -EPERM;
+
+	pcpu = &pcpus[task->affinity];
+	bw = (runtime << DL_BW_SHIFT) / period;
+
+	spin_lock(&dl_bw_lock);
+	if (pcpu->dl_bw + bw > DL_BW_LIMIT) {
+		spin_unlock(&dl_bw_lock);
+		pr_err("pcpu%d can not admit %s, bw %d + %d > %d\n",
+				pcpu->pcpu_id, task->name,
+				pcpu->dl_bw, bw, DL_BW_LIMIT);
+		return -ENOSPC;
+	}
+	pcpu->dl_bw += bw;
+	spin_unlock(&dl_bw_lock);
+
+	task->dl.runtime = runtime;
+	task->dl.deadline = deadline;
+	task->dl.period = period;
+	task->dl.bw = bw;
+	task->dl.abs_deadline = 0;
+	task->dl.budget = 0;
+	task->throttled = 0;
+	init_timer(&task->dl.timer, dl_timer_handler, (unsigned long)task);
+	task->prio = OS_PRIO_DEADLINE;
+
+	return 0;
+}
+
+void task_clear_deadline(struct task *task)
+{
+	if (!task_is_dl(task))
+		return;
+
+	stop_timer(&task->dl.timer);
+
+	spin_lock(&dl_bw_lock);
+	pcpus[task->affinity].dl_bw -= task->dl.bw;
+	spin_unlock(&dl_bw_lock);
+
+	task->dl.runtime = 0;
+}
+
+/*
+ * the task which is waiting event is still in the ready
+ * list if it has not been switched out.
+ */
+static inline int task_on_ready_list(struct task *task)
+{
+	return (task->state_list.next != NULL) &&
+		(task->state != TASK_STATE_STOP);
+}
+
+/*
+ * move the task which is in the ready list to another
+ * prio, the nr_ready of the pcpu is not changed.
+ */
+static void change_task_prio(struct pcpu *pcpu, struct task *task, int prio)
+{
+	list_del(&task->state_list);
+	if (is_list_empty(&pcpu->ready_list[task->prio]))
+		pcpu_clear_prio_ready(pcpu, task->prio);
+	pcpu->tasks_in_prio[task->prio]--;
+
+	task->prio = prio;
+	pcpu->tasks_in_prio[prio]++;
+	list_add_tail(&pcpu->ready_list[prio], &task->state_list);
+	pcpu_set_prio_ready(pcpu, prio);
+}
+
+static void credit_debit(struct task *task, unsigned long now)
+{
+	struct task_credit *cr = &task->credit;
+	unsigned long delta = now - cr->stamp;
+
+	cr->credit -= (long)delta;
+	cr->run_ns += delta;
+	cr->stamp = now;
+}
+
+/*
+ * the task is going to wait event or stop, it is not on the
+ * ready list any more, clear the throttled flag like the
+ * deadline task, the credit is checked again when it is
+ * waked up and running.
+ */
+static void credit_task_switch_out(struct task *task, unsigned long now)
+{
+	credit_debit(task, now);
+
+	if (task->state != TASK_STATE_READY)
+		task->throttled = 0;
+}
+
+static void credit_refill(struct pcpu *pcpu, struct task *task)
+{
+	struct task_credit *cr = &task->credit;
+	long share;
+
+	share = CREDIT_PERIOD * cr->weight / pcpu->credit_weight;
+	if (cr->cap)
+		share = MIN(share, (long)(CREDIT_PERIOD * cr->cap / 100));
+
+	/*
+	 * the task which is idle can not save the credit
+	 * for more than one period.
+	 */
+	cr->entitled_ns += share;
+	cr->credit = MIN(cr->credit + share, share);
+}
+
+/*
+ * the task which has credit run at OS_PRIO_VCPU, and the
+ * one which used up its credit run at OS_PRIO_VCPU_OVER,
+ * if the task is capped, it will be parked until the next
+ * period.
+ */
+static void credit_update_task(struct pcpu *pcpu, struct task *task)
+{
+	struct task_credit *cr = &task->credit;
+	int prio = (cr->credit > 0) ? OS_PRIO_VCPU : OS_PRIO_VCPU_OVER;
+
+	if (cr->cap && (cr->credit <= 0)) {
+		if (task->throttled)
+			return;
+
+		if ((task == current) && task_is_running(task)) {
+			task->throttled = 1;
+			set_need_resched();
+		} else if (task->state == TASK_STATE_READY) {
+			remove_task_from_ready_list(pcpu, task);
+			task->throttled = 1;
+		} else {
+			return;
+		}
+
+		cr->nr_park++;
+		return;
+	}
+
+	/*
+	 * only the parked task which is still ready and not
+	 * on the ready list can be put back to the ready list.
+	 */
+	if (task->throttled) {
+		task->throttled = 0;
+		if (task->gang_boost)
+			task->gang_prio = prio;
+		else
+			task->prio = prio;
+		if ((task->state == TASK_STATE_READY) &&
+				!task_on_ready_list(task))
+			task_ready(task, 0);
+		return;
+	}
+
+	if ((task->prio == prio) || task->gang_boost)
+		return;
+
+	if (task_on_ready_list(task)) {
+		change_task_prio(pcpu, task, prio);
+		set_need_resched();
+	} else {
+		task->prio = prio;
+	}
+}
+
+static void credit_tick_handler(unsigned long data)
+{
+	struct pcpu *pcpu = (struct pcpu *)data;
+	struct task *task, *cur = current;
+	int keep = 1;
+
+	spin_lock(&credit_lock);
+
+	if (task_is_credit(cur))
+		credit_debit(cur, NOW());
+
+	/*
+	 * give the credit to all the tasks on this pcpu, stop
+	 * the tick if no credit task is running or waiting to
+	 * run, the tick will restart when a credit task is
+	 * switched in.
+	 */
+	if (++pcpu->credit_ticks >= CREDIT_TICKS_PER_PERIOD) {
+		pcpu->credit_ticks = 0;
+		keep = task_is_credit(cur);
+
+		list_for_each_entry(task, &pcpu->credit_list, credit.list) {
+			credit_refill(pcpu, task);
+			credit_update_task(pcpu, task);
+			if (task->state == TASK_STATE_READY)
+				keep = 1;
+		}
+	} else if (task_is_credit(cur)) {
+		credit_update_task(pcpu, cur);
+	}
+
+	if (keep)
+		setup_and_start_timer(&pcpu->credit_timer, CREDIT_TICK);
+	else
+		pcpu->credit_active = 0;
+
+	spin_unlock(&credit_lock);
+}
+
+/*
+ * schedule the task by credit, the task must be a vcpu
+ * task which is pinned to one pcpu, the weight and the
+ * cap can be changed at any time.
+ */
+int task_set_credit(struct task *task, int weight, int cap)
+{
+	struct pcpu *pcpu;
+	unsigned long flags;
+
+	if ((weight <= 0) || (cap < 0) || (cap > 100))
+		return -EINVAL;
+
+	if ((task->affinity == TASK_AFF_ANY) || task_is_dl(task) ||
+			!task_is_vcpu(task))
+		return -EPERM;
+
+	pcpu = &pcpus[task->affinity];
+
+	spin_lock_irqsave(&credit_lock, flags);
+	if (task_is_credit(task)) {
+		pcpu->credit_weight -= task->credit.weight;
+	} else {
+		task->credit.credit = 0;
+		task->credit.stamp = NOW();
+		list_add_tail(&pcpu->credit_list, &task->credit.list);
+	}
+
+	task->credit.cap = cap;
+	task->credit.weight = weight;
+	pcpu->credit_weight += weight;
+	spin_unlock_irqrestore(&credit_lock, flags);
+
+	return 0;
+}
+
+void task_clear_credit(struct task *task)
+{
+	unsigned long flags;
+
+	if (!task_is_credit(task))
+		return;
+
+	spin_lock_irqsave(&credit_lock, flags);
+	list_del(&task->credit.list);
+	pcpus[task->affinity].credit_weight -= task->credit.weight;
+	task->credit.weight = 0;
+	spin_unlock_irqrestore(&credit_lock, flags);
+}
+
+/*
+ * the time is split into slots, each frame has one slot
+ * for each gang and one slot for the tasks not in any gang,
+ * all the pcpus see the same system time, so they switch
+ * to the next slot at the same time without any sync.
+ */
+static int gang_slot_owner(unsigned long slot)
+{
+	int gang, idx = slot % (nr_gangs + 1);
+
+	for_each_set_bit(gang, gang_map, SCHED_MAX_GANG) {
+		if (idx-- == 0)
+			return gang;
+	}
+
+	return -1;
+}
+
+static void gang_boost_task(struct pcpu *pcpu, struct task *task, int boost)
+{
+	int prio;
+
+	if (task->gang_boost == boost)
+		return;
+
+	task->gang_boost = boost;
+	if (boost) {
+		task->gang_prio = task->prio;
+		prio = OS_PRIO_VCPU_GANG;
+	} else {
+		prio = task->gang_prio;
+	}
+
+	if (task_on_ready_list(task)) {
+		change_task_prio(pcpu, task, prio);
+		set_need_resched();
+	} else {
+		task->prio = prio;
+	}
+}
+
+static void gang_slot_handler(unsigned long data)
+{
+	struct pcpu *pcpu = (struct pcpu *)data;
+	struct task *task;
+	unsigned long slot;
+	int owner;
+
+	/*
+	 * the timer may expire a little earlier or later,
+	 * round to the nearest slot boundary.
+	 */
+	slot = (NOW() + GANG_SLOT / 2) / GANG_SLOT;
+
+	spin_lock(&gang_lock);
+	owner = gang_slot_owner(slot);
+	list_for_each_entry(task, &pcpu->gang_list, gang_list)
+		gang_boost_task(pcpu, task, task->gang == owner);
+
+	if (is_list_empty(&pcpu->gang_list))
+		pcpu->gang_active = 0;
+	else
+		mod_timer(&pcpu->gang_timer, (slot + 1) * GANG_SLOT);
+	spin_unlock(&gang_lock);
+}
+
+static void gang_timer_start(void *data)
+{
+	struct pcpu *pcpu = get_pcpu();
+
+	if (pcpu->gang_active || pcpu->nohz_full)
+		return;
+
+	pcpu->gang_active = 1;
+	mod_timer(&pcpu->gang_timer, (NOW() / GANG_SLOT + 1) * GANG_SLOT);
+}
+
+int sched_gang_alloc(void)
+{
+	unsigned long flags;
+	int gang;
+
+	spin_lock_irqsave(&gang_lock, flags);
+	gang = find_first_zero_bit(gang_map, SCHED_MAX_GANG);
+	if (gang >= SCHED_MAX_GANG) {
+		gang = -ENOSPC;
+	} else {
+		set_bit(gang, gang_map);
+		nr_gangs++;
+	}
+	spin_unlock_irqrestore(&gang_lock, flags);
+
+	return gang;
+}
+
+void sched_gang_free(int gang)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&gang_lock, flags);
+	if (test_and_clear_bit(gang, gang_map))
+		nr_gangs--;
+	spin_unlock_irqrestore(&gang_lock, flags);
+}
+
+/*
+ * the task must be a vcpu task pinned to one pcpu, the
+ * tasks in one gang should be pinned to different pcpus.
+ */
+int task_join_gang(struct task *task, int gang)
+{
+	unsigned long flags;
+
+	if ((gang < 0) || (gang >= SCHED_MAX_GANG))
+		return -EINVAL;
+
+	if ((task->affinity == TASK_AFF_ANY) || task_is_dl(task) ||
+			!task_is_vcpu(task))
+		return -EPERM;
+
+	spin_lock_irqsave(&gang_lock, flags);
+	if (task->gang != -1) {
+		spin_unlock_irqrestore(&gang_lock, flags);
+		return -EBUSY;
+	}
+
+	task->gang = gang;
+	task->gang_boost = 0;
+	list_add_tail(&pcpus[task->affinity].gang_list, &task->gang_list);
+	spin_unlock_irqrestore(&gang_lock, flags);
+
+	/*
+	 * start the slot timer on the pcpu of the task.
+	 */
+	smp_function_call(task->affinity, gang_timer_start, NULL, 0);
+
+	return 0;
+}
+
+void task_leave_gang(struct task *task)
+{
+	unsigned long flags;
+
+	if (task->gang == -1)
+		return;
+
+	spin_lock_irqsave(&gang_lock, flags);
+	list_del(&task->gang_list);
+	task->gang = -1;
+	task->gang_boost = 0;
+	spin_unlock_irqrestore(&gang_lock, flags);
+}
+
 void task_sleep(uint32_t delay)
 {
 	struct task *task = current;
@@ -237,7 +1083,7 @@ static struct task *pick_next_task(struct pcpu *pcpu)
 	mb();
 	ASSERT(task->state != TASK_STATE_READY);
 
-	if (!task_is_running(task)) {
+	if (!task_is_running(task) || task->throttled) {
 		remove_task_from_ready_list(pcpu, task);
                 if (task->state == TASK_STATE_STOP) {
                         list_add_tail(&pcpu->stop_list, &task->state_list);
@@ -248,22 +1094,131 @@ static struct task *pick_next_task(struct pcpu *pcpu)
 	/*
 	 * get the highest ready task list to running
 	 */
-	prio = ffs_one_table[pcpu->local_rdy_grp];
+	prio = pcpu_highest_prio(pcpu);
 	ASSERT(prio != -1);
 	head = &pcpu->ready_list[prio];
 
 	/*
 	 * get the first task, then put the next running
-	 * task to the end of the ready list.
+	 * task to the end of the ready list, the deadline
+	 * tasks keep sorted by the deadline.
 	 */
 	ASSERT(!is_list_empty(head));
 	task = list_first_entry(head, struct task, state_list);
-	list_del(&task->state_list);
-	list_add_tail(head, &task->state_list);
+	if (prio != OS_PRIO_DEADLINE) {
+		list_del(&task->state_list);
+		list_add_tail(head, &task->state_list);
+	}
 
 	return task;
 }
 
+static void dl_task_switch_out(struct task *task, unsigned long now)
+{
+	struct task_dl *dl = &task->dl;
+
+	stop_timer(&dl->timer);
+	dl->budget -= (long)(now - task->start_ns);
+
+	/*
+	 * the task is going to wait event or stop, count a
+	 * miss if the work is finished after the deadline, the
+	 * budget is checked again when it is waked up.
+	 */
+	if (task->state != TASK_STATE_READY) {
+		if (now > dl->abs_deadline)
+			dl->nr_miss++;
+		task->throttled = 0;
+		return;
+	}
+
+	/*
+	 * the budget is used up, the task has been removed
+	 * from the ready list, replenish it at the start of
+	 * the next period.
+	 */
+	if (task->throttled) {
+		dl->nr_throttle++;
+		mod_timer(&dl->timer, dl->abs_deadline -
+				dl->deadline + dl->period);
+	}
+}
+
+static void dl_task_switch_in(struct pcpu *pcpu,
+		struct task *task, unsigned long now)
+{
+	struct task_dl *dl = &task->dl;
+
+	/*
+	 * the task was ready but can not get the pcpu before
+	 * its deadline, count a miss and start a new period,
+	 * the ready list need to be sorted again.
+	 */
+	if (now > dl->abs_deadline) {
+		dl->nr_miss++;
+		dl->abs_deadline = now + dl->deadline;
+		dl->budget = dl->runtime;
+		list_del(&task->state_list);
+		dl_insert_ready_list(pcpu, task);
+	}
+
+	/*
+	 * arm the timer to throttle the task when the budget
+	 * is used up.
+	 */
+	mod_timer(&dl->timer, now + dl->budget);
+}
+
+static inline int sched_lat_bucket(unsigned long ns)
+{
+	return MIN(fls64(ns / 1000), SCHED_LAT_BUCKETS - 1);
+}
+
+static void stat_task_switch_out(struct pcpu *pcpu,
+		struct task *task, unsigned long now)
+{
+	struct task_stat *st = &task->stat;
+	unsigned long delta = now - task->start_ns;
+
+	st->run_ns += delta;
+	pcpu->busy_ns += delta;
+
+	/*
+	 * the task is still ready to run, it is preempted by
+	 * other task.
+	 */
+	if (task->state == TASK_STATE_READY) {
+		st->nr_preempt++;
+		pcpu->nr_preempt++;
+		st->ready_stamp = now;
+		st->woken = 0;
+	}
+}
+
+static void stat_task_switch_in(struct pcpu *pcpu,
+		struct task *task, unsigned long now)
+{
+	struct task_stat *st = &task->stat;
+	unsigned long wait;
+	int idx;
+
+	if (st->ready_stamp == 0)
+		return;
+
+	wait = (now > st->ready_stamp) ? (now - st->ready_stamp) : 0;
+	st->wait_ns += wait;
+	pcpu->wait_ns += wait;
+
+	if (st->woken) {
+		idx = sched_lat_bucket(wait);
+		st->lat_hist[idx]++;
+		pcpu->lat_hist[idx]++;
+		st->woken = 0;
+	}
+
+	st->ready_stamp = 0;
+}
+
 static void switch_to_task(struct task *cur, struct task *next)
 {
 	struct pcpu *pcpu = get_pcpu();
@@ -273,6 +1228,8 @@ static void switch_to_task(struct task *cur, struct task *next)
 	do_hooks((void *)cur, NULL, OS_HOOK_TASK_SWITCH_OUT);
 
 	now = NOW();
+	if (!task_is_idle(cur))
+		pcpu_update_load(pcpu, now, now - cur->start_ns);
 
 	/* 
 	 * check the current task's state and do some action
@@ -288,6 +1245,14 @@ static void switch_to_task(struct task *cur, struct task *next)
 	else if (cur->state == TASK_STATE_RUNNING)
 		cur->state = TASK_STATE_READY;
 
+	if (task_is_dl(cur))
+		dl_task_switch_out(cur, now);
+	else if (task_is_credit(cur))
+		credit_task_switch_out(cur, now);
+
+	if (!task_is_idle(cur))
+		stat_task_switch_out(pcpu, cur, now);
+
 	cur->last_cpu = cur->cpu;
 	cur->run_time = CONFIG_TASK_RUN_TIME;
 	smp_wmb();
@@ -298,11 +1263,24 @@ static void switch_to_task(struct task *cur, struct task *next)
 	 * safe, the task is offline now.
 	 */
 	cur->cpu = -1;
-	smp_wmb();
+	smp_mb();
 
 	/*
 	 * change the current task to next task.
 	 */
+	if (!task_is_idle(next))
+		stat_task_switch_in(pcpu, next, now);
+
+	if (task_is_dl(next)) {
+		dl_task_switch_in(pcpu, next, now);
+	} else if (task_is_credit(next)) {
+		next->credit.stamp = now;
+		if (!pcpu->credit_active && !pcpu->nohz_full) {
+			pcpu->credit_active = 1;
+			setup_and_start_timer(&pcpu->credit_timer, CREDIT_TICK);
+		}
+	}
+
 	next->state = TASK_STATE_RUNNING;
 	next->ti.flags &= ~__TIF_TICK_EXHAUST;
 	next->cpu = pcpu->pcpu_id;
@@ -316,6 +1294,17 @@ static void switch_to_task(struct task *cur, struct task *next)
 	next->wait_event = 0;
 	next->start_ns = now;
 	smp_wmb();
+
+	/*
+	 * other cpu try to wake up the task when it is still
+	 * switching out, finish the wakeup here.
+	 */
+	if (cur->wake_pending && xchg(&cur->wake_pending, 0)) {
+		pcpu->nr_wake_deferred++;
+		if (cur->pend_state != TASK_STATE_PEND_TO)
+			stop_timer(&cur->delay_timer);
+		__task_ready(cur, 1, 1);
+	}
 }
 
 static void sched_tick_handler(unsigned long data)
@@ -426,22 +1415,20 @@ static int irqwork_handler(uint32_t irq, void *data)
 {
 	struct pcpu *pcpu = get_pcpu();
 	struct task *task, *n;
-	int preempt = 0, need_preempt;
+	int preempt = 0, need_preempt, cpu;
 
 	/*
 	 * check whether there are new taskes need to
 	 * set to ready state again
 	 */
-	raw_spin_lock(&pcpu->lock);
-	list_for_each_entry_safe(task, n, &pcpu->new_list, state_list) {
-		/*
-		 * remove it from the new_next.
-		 */
-		list_del(&task->state_list);
+	for (task = wake_list_take_all(pcpu); task != NULL; task = n) {
+		n = task->wake_next;
+		task->wake_next = NULL;
 
 		if (task->state == TASK_STATE_RUNNING) {
 			pr_err("task %s state %d wrong\n",
 				task->name? task->name : "Null", task->state);
+			pcpu_ready_dec(pcpu, task);
 			continue;
 		}
 
@@ -460,7 +1447,15 @@ static int irqwork_handler(uint32_t irq, void *data)
 			task->delay = 0;
 		}
 	}
-	raw_spin_unlock(&pcpu->lock);
+
+	/*
+	 * other pcpu request to pull a task from this pcpu.
+	 */
+	cpu = xchg(&pcpu->steal_cpu, -1);
+	if (cpu != -1)
+		pcpu_push_task(pcpu, cpu);
+
+	timer_irqwork();
 
 	if (preempt || task_is_idle(current))
 		set_need_resched();
@@ -479,6 +1474,8 @@ int local_sched_init(void)
 	struct pcpu *pcpu = get_pcpu();
 
 	init_timer(&pcpu->sched_timer, sched_tick_handler, (unsigned long)pcpu);
+	init_timer(&pcpu->credit_timer, credit_tick_handler, (unsigned long)pcpu);
+	init_timer(&pcpu->gang_timer, gang_slot_handler, (unsigned long)pcpu);
 
 	pcpu->state = PCPU_STATE_RUNNING;
 
@@ -486,21 +1483,57 @@ int local_sched_init(void)
 			0, "resched handler", NULL);
 	request_irq(CONFIG_MINOS_IRQWORK_IRQ, irqwork_handler,
 			0, "irqwork handler", NULL);
+
+#if CONFIG_SCHED_BALANCE_PERIOD > 0
+	if (pcpu->pcpu_id == HOUSEKEEPING_CPU) {
+		init_deferrable_timer(&balance_timer, sched_balance_handler, 0);
+		setup_and_start_timer(&balance_timer,
+				MILLISECS(CONFIG_SCHED_BALANCE_PERIOD));
+	}
+#endif
+
 	return 0;
 }
 
 static void pcpu_sched_init(struct pcpu *pcpu)
 {
-	init_list(&pcpu->new_list);
+	int i;
+
+	pcpu->wake_list = NULL;
 	init_list(&pcpu->stop_list);
-	init_list(&pcpu->ready_list[0]);
-	init_list(&pcpu->ready_list[1]);
-	init_list(&pcpu->ready_list[2]);
-	init_list(&pcpu->ready_list[3]);
-	init_list(&pcpu->ready_list[4]);
-	init_list(&pcpu->ready_list[5]);
-	init_list(&pcpu->ready_list[6]);
-	init_list(&pcpu->ready_list[7]);
+	init_list(&pcpu->credit_list);
+	init_list(&pcpu->gang_list);
+	pcpu->steal_cpu = -1;
+
+	for (i = 0; i < OS_PRIO_MAX; i++)
+		init_list(&pcpu->ready_list[i]);
+}
+
+static void nohz_full_init(void)
+{
+	uint32_t mask = 0;
+	int i;
+
+	/*
+	 * nohz_full=<hex cpu mask> in the bootargs, the
+	 * housekeeping pcpu can not be nohz_full.
+	 */
+	if (bootarg_parse_hex32("nohz_full", &mask))
+		return;
+
+	if (mask & BIT(HOUSEKEEPING_CPU)) {
+		pr_warn("pcpu%d is the housekeeping pcpu, can not be nohz_full\n",
+				HOUSEKEEPING_CPU);
+		mask &= ~BIT(HOUSEKEEPING_CPU);
+	}
+
+	for (i = 0; i < NR_CPUS; i++) {
+		if (!(mask & BIT(i)))
+			continue;
+
+		pcpus[i].nohz_full = 1;
+		pr_notice("pcpu%d is in nohz_full mode\n", i);
+	}
 }
 
 int sched_init(void)
@@ -510,6 +1543,8 @@ int sched_init(void)
 	for (i = 0; i < NR_CPUS; i++)
 		pcpu_sched_init(&pcpus[i]);
 
+	nohz_full_init();
+
 	return 0;
 }
 
@@ -590,20 +1625,10 @@ static int wake_up_common(struct task *task, long pend_state, int event, void *d
 	}
 
 	/*
-	 * the task may in sched() routine on other cpu
-	 * wait the task really out of running. since the task
-	 * will not preempt in the kernel space now, so the cpu
-	 * of the task will change to -1 at one time.
-	 *
-	 * since the kernel can not be preempted so it can make
-	 * sure that sched() can be finish its work.
-	 */
-	while (task->cpu != -1)
-		cpu_relax();
-
-	/*
-	 * here this cpu got this task, and can set the new
-	 * state to running and run it again.
+	 * set the new state of the task, the cpu which is
+	 * switching out this task only check whether the state
+	 * is TASK_STATE_WAIT_EVENT and the delay to setup the
+	 * timeout timer, so these can be changed here.
 	 */
 	task->pend_state = pend_state;
 	task->state = TASK_STATE_WAKING;
@@ -617,6 +1642,21 @@ static int wake_up_common(struct task *task, long pend_state, int event, void *d
 		task->flags_rdy = 0;
 	}
 
+	/*
+	 * the task may in sched() routine on other cpu, do not
+	 * wait the task really out of running, mark the wakeup
+	 * pending, if the task is still on the cpu, the cpu will
+	 * finish the wakeup after it is switched out. the one
+	 * which clear wake_pending will finish the wakeup.
+	 */
+	task->wake_pending = 1;
+	smp_mb();
+	if ((task->cpu != -1) || !xchg(&task->wake_pending, 0)) {
+		spin_unlock_irqrestore(&task->s_lock, flags);
+		preempt_enable();
+		return 0;
+	}
+
 	spin_unlock_irqrestore(&task->s_lock, flags);
 
 	/*
@@ -24,6 +24,7 @@ static DEFINE_SPIN_LOCK(tid_lock);
 static DECLARE_BITMAP(tid_map, OS_NR_TASKS);
 struct task *os_task_table[OS_NR_TASKS];
 static LIST_HEAD(task_list);
+static struct kmem_cache *task_cache;
 
 /* idle task needed be static defined */
 struct task idle_tasks[NR_CPUS];
@@ -73,6 +74,9 @@ static int tid_early_init(void)
 	 */
 	set_bit(0, tid_map);
 
+	task_cache = kmem_cache_create("task", sizeof(struct task), NULL);
+	ASSERT(task_cache != NULL);
+
 	return 0;
 }
 early_initcall(tid_early_init);
@@ -112,10 +116,19 @@ static void task_init(struct task *task, char *name,
 	spin_lock_init(&task->s_lock);
 	task->state = TASK_STATE_SUSPEND;
 	task->cpu = -1;
+	task->gang = -1;
 
 	init_timer(&task->delay_timer, task_timeout_handler,
 			(unsigned long)task);
 
+	/*
+	 * the timeout of the system task such as kworker is
+	 * not time critical, vcpu and realtime task need the
+	 * exact timeout.
+	 */
+	if (!(opt & (TASK_FLAGS_VCPU | TASK_FLAGS_REALTIME)))
+		set_timer_slack(&task->delay_timer, TIMER_SLACK_DEFAULT);
+
 	os_task_table[tid] =  task;
 
 	if (name)
@@ -140,7 +153,7 @@ static struct task *do_create_task(char *name,
 	/*
 	 * allocate the task's kernel stack
 	 */
-	task = zalloc(sizeof(struct task));
+	task = kmem_cache_zalloc(task_cache);
 	if (!task) {
 		pr_err("no more memory for task\n");
 		return NULL;
@@ -149,7 +162,7 @@ static struct task *do_create_task(char *name,
 	stack = get_free_pages(PAGE_NR(stk_size));
 	if (!stack) {
 		pr_err("no more memory for task stack\n");
-		free(task);
+		kmem_cache_free(task_cache, task);
 		return NULL;
 	}
 
@@ -197,15 +210,18 @@ void task_return_to_user(gp_regs *regs)
 
 void do_release_task(struct task *task)
 {
+	task_clear_deadline(task);
+	task_clear_credit(task);
+	task_leave_gang(task);
 	arch_release_task(task);
 	free_pages(task->stack_bottom);
-	free(task);
 
 	/*
 	 * this function can not be called at interrupt
 	 * context, use release_task is more safe
 	 */
 	release_tid(task->tid);
+	kmem_cache_free(task_cache, task);
 }
 
 struct task *__create_task(char *name,
@@ -225,7 +241,8 @@ struct task *__create_task(char *name,
 		aff = TASK_AFF_ANY;
 	}
 
-	if ((prio >= OS_PRIO_IDLE) || (prio < 0)) {
+	if ((prio >= OS_PRIO_IDLE) || (prio < 0) || (prio == OS_PRIO_DEADLINE) ||
+			(prio == OS_PRIO_VCPU_OVER)) {
 		pr_warn("wrong task prio %d fallback to %d\n",
 				prio, OS_PRIO_DEFAULT_6);
 		prio = OS_PRIO_DEFAULT_6;
@@ -317,12 +334,23 @@ int create_idle_task(void)
 	task_create_hook(task);
 
 	list_add_tail(&pcpu->ready_list[task->prio], &task->state_list);
-	pcpu->local_rdy_grp |= BIT(task->prio);
+	pcpu_set_prio_ready(pcpu, task->prio);
 	pcpu->idle_task = task;
 
 	return 0;
 }
 
+/*
+ * move the pending timers of the task to the pcpu which the
+ * task will run on, then the timers will expire on the same
+ * pcpu with the task.
+ */
+void task_migrate_timers(struct task *task, int cpu)
+{
+	migrate_timer(&task->delay_timer, cpu);
+	migrate_timer(&task->dl.timer, cpu);
+}
+
 void os_for_all_task(void (*hdl)(struct task *task))
 {
         struct task *task;
@@ -22,6 +22,7 @@
 #include <minos/softirq.h>
 #include <minos/time.h>
 #include <minos/arch.h>
+#include <minos/sched.h>
 
 #define TIMER_PRECISION 1000000 // 1ms 1000ns
 
@@ -29,164 +30,585 @@ DEFINE_PER_CPU(struct raw_timer, timers);
 
 #define DEFAULT_TIMER_MARGIN	(TIMER_PRECISION / 2)
 
-void soft_timer_interrupt(void)
+/*
+ * the high resolution timer is used to emulate the timer
+ * of the guest, it is not rounded to TIMER_PRECISION.
+ */
+#define TIMER_HRES_PRECISION	1000	// 1us
+#define TIMER_HRES_MARGIN	1000
+
+static inline unsigned long timer_tick(uint64_t ns)
+{
+	return (unsigned long)(ns >> TIMER_WHEEL_TICK_SHIFT);
+}
+
+static inline int timer_pending(const struct timer * timer)
+{
+	return ((timer->entry.next) != NULL);
+}
+
+static inline uint64_t timer_precision(struct timer *timer)
+{
+	return (timer->flags & TIMER_HRES) ?
+		TIMER_HRES_PRECISION : TIMER_PRECISION;
+}
+
+static inline uint64_t timer_margin(struct timer *timer)
+{
+	return (timer->flags & TIMER_HRES) ?
+		TIMER_HRES_MARGIN : DEFAULT_TIMER_MARGIN;
+}
+
+static void wheel_enqueue(struct raw_timer *timers, struct timer *timer)
+{
+	unsigned long tick = timer_tick(timer->expires);
+	unsigned long delta;
+	int lvl, idx;
+
+	if (tick < timers->clk)
+		tick = timers->clk;
+	delta = tick - timers->clk;
+
+	for (lvl = 0; lvl < TIMER_LVL_DEPTH - 1; lvl++) {
+		if (delta < (1UL << ((lvl + 1) * TIMER_LVL_BITS)))
+			break;
+	}
+
+	/*
+	 * the timer beyond the range of the wheel is put in
+	 * the last slot, it will be cascaded again when the
+	 * wheel turn to it.
+	 */
+	if (delta >= (1UL << (TIMER_LVL_DEPTH * TIMER_LVL_BITS)))
+		tick = timers->clk + (1UL << (TIMER_LVL_DEPTH * TIMER_LVL_BITS)) - 1;
+
+	idx = (tick >> (lvl * TIMER_LVL_BITS)) & TIMER_LVL_MASK;
+	timer->slot = lvl * TIMER_LVL_SIZE + idx;
+	list_add_tail(&timers->wheel[lvl][idx], &timer->entry);
+	timers->pending_map[lvl] |= BIT(idx);
+	timers->nr_pending++;
+}
+
+static void wheel_dequeue(struct raw_timer *timers, struct timer *timer)
+{
+	int lvl = timer->slot / TIMER_LVL_SIZE;
+	int idx = timer->slot % TIMER_LVL_SIZE;
+
+	list_del(&timer->entry);
+
+	/*
+	 * slot -1 means the timer is already expired and on
+	 * the local expired list of soft_timer_interrupt.
+	 */
+	if (timer->slot < 0)
+		return;
+
+	if (is_list_empty(&timers->wheel[lvl][idx]))
+		timers->pending_map[lvl] &= ~BIT(idx);
+	timers->nr_pending--;
+	timer->slot = -1;
+}
+
+/*
+ * move the timers in the slot of the higher level which
+ * the wheel turn to now to the lower level, called when
+ * the index of the level 0 wrap to 0.
+ */
+static void wheel_cascade(struct raw_timer *timers)
 {
-	struct raw_timer *timers = &get_cpu_var(timers);
-	struct timer *timer, *next_timer = NULL;
 	struct list_head tmp_head;
-	uint64_t now;
-	timer_func_t fn;
-	unsigned long data;
+	struct list_head *head;
+	struct timer *timer;
+	int lvl, idx;
 
-	raw_spin_lock(&timers->lock);
 	init_list(&tmp_head);
-	now = NOW();
-
-	while (!is_list_empty(&timers->active)) {
-		timer = list_first_entry(&timers->active, struct timer, entry);
-		if (timer->expires <= (now + DEFAULT_TIMER_MARGIN)) {	
-			/* 
-			 * need to release the spin lock to avoid
-			 * dead lock because on the timer handler
-			 * function the task may aquire other spinlocks
-			 * so load the function and data on the stack.
-			 */
-			timers->running_timer = timer;
-			smp_wmb();
-
-			fn = timer->function;
-			data = timer->data;
-			list_del(&timer->entry);
-			timer->entry.next = NULL;
-			raw_spin_unlock(&timers->lock);
 
-			if (!timer->stop) {
-				fn(data);
-				mb();
-			}
+	for (lvl = 1; lvl < TIMER_LVL_DEPTH; lvl++) {
+		idx = (timers->clk >> (lvl * TIMER_LVL_BITS)) & TIMER_LVL_MASK;
+		head = &timers->wheel[lvl][idx];
+
+		/*
+		 * the timer may be queued to the same slot again,
+		 * so move them to the tmp list first.
+		 */
+		while (!is_list_empty(head)) {
+			timer = list_first_entry(head, struct timer, entry);
+			wheel_dequeue(timers, timer);
+			list_add_tail(&tmp_head, &timer->entry);
+		}
 
-			timers->running_timer = NULL;
-			raw_spin_lock(&timers->lock);
-		} else {
-			/*
-			 * need to be careful one case, when do the expires
-			 * handler, the spin lock will be released, then other
-			 * cpu may get this lock to delete the timer from the
-			 * active list, if use the .next member to get the next
-			 * timer then there will be issues, so if this timer not
-			 * expires, then add it to the tmp timer list head, at
-			 * the end of this function, switch the actvie to the head
-			 */
-			if (!next_timer || (next_timer->expires > timer->expires))
-				next_timer = timer;
+		while (!is_list_empty(&tmp_head)) {
+			timer = list_first_entry(&tmp_head, struct timer, entry);
 			list_del(&timer->entry);
-			list_add_tail(&tmp_head, &timer->entry);
+			wheel_enqueue(timers, timer);
 		}
+
+		if (idx != 0)
+			break;
 	}
+}
 
-	if (!is_list_empty(&timers->active))
-		panic("error in timers->active list\n");
+static struct timer *slot_next_timer(struct list_head *head,
+		struct timer *next_timer)
+{
+	struct timer *timer;
 
-	/*
-	 * swap the tmp head to the active head
-	 */
-	if (!is_list_empty(&tmp_head)) {
-		tmp_head.next->pre = &timers->active;
-		timers->active.next = tmp_head.next;
-		tmp_head.pre->next = &timers->active;
-		timers->active.pre = tmp_head.pre;
-		wmb();
+	list_for_each_entry(timer, head, entry) {
+		if (!next_timer || (next_timer->expires > timer->expires))
+			next_timer = timer;
 	}
 
-	raw_spin_unlock(&timers->lock);
+	return next_timer;
+}
+
+/*
+ * the slots of one level are sorted by time starting from
+ * the slot which the wheel turn to, so only the current slot
+ * and the first pending slot after it need to be checked. the
+ * levels are not sorted since the timer is queued by the clk
+ * when it is armed, check all of them.
+ */
+static struct timer *find_next_timer(struct raw_timer *timers)
+{
+	struct timer *next_timer = NULL;
+	unsigned long map, rot;
+	int lvl, pos, idx;
+
+	if (timers->nr_pending == 0)
+		return NULL;
+
+	for (lvl = 0; lvl < TIMER_LVL_DEPTH; lvl++) {
+		map = timers->pending_map[lvl];
+		if (!map)
+			continue;
+
+		pos = (timers->clk >> (lvl * TIMER_LVL_BITS)) & TIMER_LVL_MASK;
+		if (map & BIT(pos))
+			next_timer = slot_next_timer(&timers->wheel[lvl][pos], next_timer);
+
+		idx = (pos + 1) & TIMER_LVL_MASK;
+		rot = (map >> idx) | (idx ? (map << (TIMER_LVL_SIZE - idx)) : 0);
+		if (!rot)
+			continue;
+
+		idx = (idx + __ffs(rot)) & TIMER_LVL_MASK;
+		if (idx != pos)
+			next_timer = slot_next_timer(&timers->wheel[lvl][idx], next_timer);
+	}
+
+	return next_timer;
+}
+
+/*
+ * turn the wheel to now, and move the expired timers to the
+ * expired list, the empty slots of level 0 are skipped by the
+ * pending_map, the timer in the slot of now which is not expired
+ * yet is kept, the wheel stop at this slot and check it again in
+ * the next round. the high resolution timer in the passed slots
+ * which is not expired yet is queued again to the slot of now.
+ */
+static void wheel_collect_expired(struct raw_timer *timers,
+		uint64_t now, struct list_head *expired)
+{
+	unsigned long now_tick = timer_tick(now + DEFAULT_TIMER_MARGIN);
+	unsigned long map, next;
+	struct timer *timer, *n;
+	struct list_head requeue;
+	int idx;
+
+	if (timers->nr_pending == 0) {
+		if (now_tick > timers->clk)
+			timers->clk = now_tick;
+		return;
+	}
+
+	init_list(&requeue);
+
+	while (timers->clk <= now_tick) {
+		idx = timers->clk & TIMER_LVL_MASK;
+		if (idx == 0)
+			wheel_cascade(timers);
+
+		list_for_each_entry_safe(timer, n, &timers->wheel[0][idx], entry) {
+			if (timer->expires <= (now + timer_margin(timer))) {
+				wheel_dequeue(timers, timer);
+				list_add_tail(expired, &timer->entry);
+			} else if (timers->clk != now_tick) {
+				wheel_dequeue(timers, timer);
+				list_add_tail(&requeue, &timer->entry);
+			}
+		}
+
+		if (timers->clk == now_tick)
+			break;
+
+		map = timers->pending_map[0] & ~((BIT(idx) << 1) - 1);
+		if (map)
+			next = (timers->clk & ~TIMER_LVL_MASK) + __ffs(map);
+		else
+			next = (timers->clk | TIMER_LVL_MASK) + 1;
+		timers->clk = MIN(next, now_tick);
+	}
+
+	while (!is_list_empty(&requeue)) {
+		timer = list_first_entry(&requeue, struct timer, entry);
+		list_del(&timer->entry);
+		wheel_enqueue(timers, timer);
+	}
+}
+
+void soft_timer_interrupt(void)
+{
+	struct raw_timer *timers = &get_cpu_var(timers);
+	struct list_head expired;
+	struct timer *timer;
+	timer_func_t fn;
+	unsigned long data;
+	int nr_expired = 0;
+
+	get_pcpu()->nr_timer_irq++;
+
+	raw_spin_lock(&timers->lock);
+	init_list(&expired);
+	wheel_collect_expired(timers, NOW(), &expired);
+
+	while (!is_list_empty(&expired)) {
+		timer = list_first_entry(&expired, struct timer, entry);
+		if (nr_expired++)
+			get_pcpu()->nr_timer_coalesced++;
+
+		/*
+		 * need to release the spin lock to avoid
+		 * dead lock because on the timer handler
+		 * function the task may aquire other spinlocks
+		 * so load the function and data on the stack.
+		 * other cpu may stop or re-arm the timer in the
+		 * expired list when the lock is released, so
+		 * always take the first one of the list.
+		 */
+		timers->running_timer = timer;
+		smp_wmb();
+
+		fn = timer->function;
+		data = timer->data;
+		list_del(&timer->entry);
+		raw_spin_unlock(&timers->lock);
+
+		if (!timer->stop) {
+			fn(data);
+			mb();
+		}
+
+		timers->running_timer = NULL;
+		raw_spin_lock(&timers->lock);
+	}
 
 	/*
 	 * already in interrupt context, will not be interrupted.
 	 */
-	timers->next_timer = next_timer;
-	if (next_timer)
-		enable_timer(next_timer->expires);
+	timers->next_timer = find_next_timer(timers);
+	if (timers->next_timer)
+		enable_timer(timers->next_timer->expires);
+
+	raw_spin_unlock(&timers->lock);
 }
 
-static inline int timer_pending(const struct timer * timer)
+static int detach_timer(struct raw_timer *timers, struct timer *timer)
 {
-	return ((timer->entry.next) != NULL);
+	if (timer_pending(timer))
+		wheel_dequeue(timers, timer);
+
+	return 0;
 }
 
-static int detach_timer(struct raw_timer *timers, struct timer *timer)
+/*
+ * move the expires of the timer which has slack in the window
+ * [expires, expires + slack], if the hardware timer will fire
+ * in this window just use it, otherwise align the expires to
+ * the most coarse boundary in the window, then the timers whose
+ * window are overlapped will get the same expires.
+ */
+static uint64_t timer_apply_slack(struct raw_timer *timers,
+		struct timer *timer)
 {
-	struct list_head *entry = &timer->entry;
+	struct timer *next_timer = timers->next_timer;
+	uint64_t limit = timer->expires + timer->slack;
+	uint64_t mask;
 
-	if (timer_pending(timer)) {
-		list_del(entry);
-		entry->next = NULL;
-	}
+	if (timer->slack == 0)
+		return timer->expires;
 
-	return 0;
+	if (next_timer && (next_timer->expires >= timer->expires) &&
+			(next_timer->expires <= limit))
+		return next_timer->expires;
+
+	mask = timer->expires ^ limit;
+	if (mask == 0)
+		return timer->expires;
+
+	mask = (1UL << (fls64(mask) - 1)) - 1;
+
+	return limit & ~mask;
 }
 
-static int __mod_timer(struct timer *timer)
+/*
+ * called in the irqwork handler, reprogram the hardware timer
+ * if other pcpu queued the first timer to expire on this pcpu.
+ */
+void timer_irqwork(void)
 {
-	struct raw_timer *timers = NULL;
+	struct raw_timer *timers = &get_cpu_var(timers);
 	unsigned long flags;
-	int cpu;
+
+	if (!timers->reprogram)
+		return;
+
+	spin_lock_irqsave(&timers->lock, flags);
+	timers->reprogram = 0;
+	if (timers->next_timer)
+		enable_timer(timers->next_timer->expires);
+	spin_unlock_irqrestore(&timers->lock, flags);
+}
+
+/*
+ * lock the raw_timer which the timer is queued on, the timer
+ * may be moved to other raw_timer before the lock is got, so
+ * check it again after the lock is got.
+ */
+static struct raw_timer *lock_timer_base(struct timer *timer,
+		unsigned long *flags)
+{
+	struct raw_timer *timers;
+
+	for (;;) {
+		timers = timer->raw_timer;
+		if (!timers)
+			return NULL;
+
+		spin_lock_irqsave(&timers->lock, *flags);
+		if (timer->raw_timer == timers)
+			return timers;
+		spin_unlock_irqrestore(&timers->lock, *flags);
+	}
+}
+
+/*
+ * lock the raw_timer the timer is queued on and the raw_timer
+ * it will be queued on, always lock the one with the lower
+ * pcpu id first to avoid dead lock.
+ */
+static struct raw_timer *lock_timer_bases(struct timer *timer,
+		struct raw_timer *new, unsigned long *flags)
+{
+	struct raw_timer *old, *first, *second;
+
+	for (;;) {
+		old = timer->raw_timer;
+		if (!old || (old == new)) {
+			spin_lock_irqsave(&new->lock, *flags);
+			if (timer->raw_timer == old)
+				return old;
+			spin_unlock_irqrestore(&new->lock, *flags);
+			continue;
+		}
+
+		first = (old->cpu < new->cpu) ? old : new;
+		second = (old->cpu < new->cpu) ? new : old;
+		spin_lock_irqsave(&first->lock, *flags);
+		raw_spin_lock(&second->lock);
+		if (timer->raw_timer == old)
+			return old;
+		raw_spin_unlock(&second->lock);
+		spin_unlock_irqrestore(&first->lock, *flags);
+	}
+}
+
+static void unlock_timer_bases(struct raw_timer *old,
+		struct raw_timer *new, unsigned long flags)
+{
+	struct raw_timer *first, *second;
+
+	if (!old || (old == new)) {
+		spin_unlock_irqrestore(&new->lock, flags);
+		return;
+	}
+
+	first = (old->cpu < new->cpu) ? old : new;
+	second = (old->cpu < new->cpu) ? new : old;
+	raw_spin_unlock(&second->lock);
+	spin_unlock_irqrestore(&first->lock, flags);
+}
+
+/*
+ * queue the timer on the raw_timer of the pcpu, cpu == -1
+ * means select the pcpu by the caller and the timer type,
+ * if the timer is queued on other pcpu it will be moved
+ * here, coalesce means the expires can be moved by slack.
+ */
+static int __mod_timer(struct timer *timer, int cpu, int coalesce)
+{
+	struct raw_timer *timers, *old, *new;
+	unsigned long flags, now_tick;
+	uint64_t expires;
+	int kick = 0;
 
 	preempt_disable();
-	cpu = smp_processor_id();
+
+	if (cpu < 0) {
+		cpu = smp_processor_id();
+
+		/*
+		 * the deferrable timer armed on a nohz_full pcpu is
+		 * queued on the housekeeping pcpu, so it will not
+		 * interrupt the vcpu which is running on this pcpu. if
+		 * it is already queued on other pcpu keep it there.
+		 */
+		if (timer->flags & TIMER_DEFERRABLE) {
+			if (timer_pending(timer) && (timer->cpu != -1))
+				cpu = timer->cpu;
+			else if (pcpu_is_nohz_full(cpu))
+				cpu = HOUSEKEEPING_CPU;
+		}
+	}
+
+	new = &get_per_cpu(timers, cpu);
+	old = lock_timer_bases(timer, new, &flags);
+	timers = new;
 
 	/*
-	 * if the timer is not on the current cpu's
-	 * timers, need to migrate it to the current
-	 * cpu's timers list
+	 * the timer is queued on other pcpu, remove it from
+	 * there. if its handler is running on that pcpu, keep
+	 * the timer on that pcpu, otherwise the handler may run
+	 * on two pcpus at the same time.
 	 */
-	ASSERT(!((timer->cpu != -1) && (timer->cpu != cpu)));
-	timers = &get_per_cpu(timers, cpu);
-
-	spin_lock_irqsave(&timers->lock, flags);
+	if (old && (old != timers)) {
+		if (old->running_timer == timer) {
+			timers = old;
+			cpu = old->cpu;
+		} else {
+			detach_timer(old, timer);
+			if (old->next_timer == timer)
+				old->next_timer = find_next_timer(old);
+		}
+	}
 
 	detach_timer(timers, timer);
+	if (timers->next_timer == timer)
+		timers->next_timer = find_next_timer(timers);
+
+	expires = coalesce ? timer_apply_slack(timers, timer) : timer->expires;
+	if (expires != timer->expires) {
+		if (timers->next_timer &&
+				(expires == timers->next_timer->expires))
+			pcpus[cpu].nr_reprogram_saved++;
+		timer->expires = expires;
+	}
+
 	timer->stop = 0;
 	timer->raw_timer = timers;
 	smp_wmb();
 
 	timer->cpu = cpu;
-	list_add_tail(&timers->active, &timer->entry);
+
+	/*
+	 * the wheel is not turned when there is no timer
+	 * pending, move it to now to avoid walking the
+	 * empty slots in the next timer interrupt.
+	 */
+	if (timers->nr_pending == 0) {
+		now_tick = timer_tick(NOW());
+		if (now_tick > timers->clk)
+			timers->clk = now_tick;
+	}
+	wheel_enqueue(timers, timer);
 
 	/*
 	 * reprogram the raw timer if the next expires bigger than
-	 * current (expires + DEFAULT_TIMER_MARGIN)
+	 * current (expires + margin), the margin of the high
+	 * resolution timer is much smaller.
 	 */
 	if (!timers->next_timer || (timers->next_timer->expires >
-				(timer->expires + DEFAULT_TIMER_MARGIN))) {
+				(timer->expires + timer_margin(timer)))) {
 		timers->next_timer = timer;
-		enable_timer(timer->expires);
+		pcpus[cpu].nr_timer_reprogram++;
+		if (cpu == smp_processor_id()) {
+			enable_timer(timer->expires);
+		} else if (!timers->reprogram) {
+			timers->reprogram = 1;
+			kick = 1;
+		}
 	}
 
-	spin_unlock_irqrestore(&timers->lock, flags);
+	unlock_timer_bases(old, new, flags);
+
+	/*
+	 * the timer is queued on other pcpu and it is the
+	 * first timer need to expire, reprogram the hardware
+	 * timer of that pcpu by its irqwork, do not wait for
+	 * that pcpu since the irq may be disabled here.
+	 */
+	if (kick)
+		pcpu_irqwork(cpu);
+
 	preempt_enable();
 
 	return 0;
 }
 
-int mod_timer(struct timer *timer, uint64_t cval)
+static uint64_t timer_clamp_expires(struct timer *timer, uint64_t cval)
 {
 	uint64_t now = NOW();
 
-	if (cval < (now + TIMER_PRECISION))
-		timer->expires = now + TIMER_PRECISION;
-	else
-		timer->expires = cval;
+	if (cval < (now + timer_precision(timer)))
+		return now + timer_precision(timer);
+
+	return cval;
+}
+
+int mod_timer(struct timer *timer, uint64_t cval)
+{
+	timer->expires = timer_clamp_expires(timer, cval);
+
+	return __mod_timer(timer, -1, 1);
+}
+
+/*
+ * arm the timer on the pcpu, the timer can be armed from
+ * any pcpu, and it is moved if it is queued on other pcpu.
+ */
+int mod_timer_on(struct timer *timer, uint64_t cval, int cpu)
+{
+	if ((cpu < 0) || (cpu >= NR_CPUS))
+		return -EINVAL;
 
-	return __mod_timer(timer);
+	timer->expires = timer_clamp_expires(timer, cval);
+
+	return __mod_timer(timer, cpu, 1);
+}
+
+/*
+ * move the pending timer to the pcpu and keep its expires,
+ * the timer which is not pending will be queued on the pcpu
+ * which arm it next time.
+ */
+int migrate_timer(struct timer *timer, int cpu)
+{
+	if ((cpu < 0) || (cpu >= NR_CPUS))
+		return -EINVAL;
+
+	if (!timer_pending(timer) || (timer->cpu == cpu))
+		return 0;
+
+	return __mod_timer(timer, cpu, 0);
 }
 
 static int __start_delay_timer(struct timer *timer)
 {
-	if (timer->timeout < TIMER_PRECISION)
-		timer->timeout = TIMER_PRECISION;
+	if (timer->timeout < timer_precision(timer))
+		timer->timeout = timer_precision(timer);
 	timer->expires = NOW() + timer->timeout;
 
-	return __mod_timer(timer);
+	return __mod_timer(timer, -1, 1);
 }
 
 void init_timer(struct timer *timer, timer_func_t fn, unsigned long data)
@@ -194,14 +616,41 @@ void init_timer(struct timer *timer, timer_func_t fn, unsigned long data)
 	preempt_disable();
 	timer->cpu = -1;
 	timer->entry.next = NULL;
+	timer->slot = -1;
 	timer->expires = 0;
 	timer->timeout = 0;
+	timer->slack = 0;
 	timer->function = fn;
 	timer->data = data;
 	timer->raw_timer = NULL;
+	timer->flags = 0;
 	preempt_enable();
 }
 
+void init_deferrable_timer(struct timer *timer, timer_func_t fn,
+		unsigned long data)
+{
+	init_timer(timer, fn, data);
+	timer->flags |= TIMER_DEFERRABLE;
+	timer->slack = TIMER_SLACK_DEFAULT;
+}
+
+void init_hres_timer(struct timer *timer, timer_func_t fn,
+		unsigned long data)
+{
+	init_timer(timer, fn, data);
+	timer->flags |= TIMER_HRES;
+}
+
+/*
+ * the new slack is used when the timer is armed next time,
+ * the timers of the realtime vcpu should keep slack 0.
+ */
+void set_timer_slack(struct timer *timer, uint64_t slack)
+{
+	timer->slack = slack;
+}
+
 int start_timer(struct timer *timer)
 {
 	return __start_delay_timer(timer);
@@ -220,23 +669,47 @@ void setup_and_start_timer(struct timer *timer, uint64_t tval)
 
 int stop_timer(struct timer *timer)
 {
-	struct raw_timer *timers = timer->raw_timer;
+	struct raw_timer *timers;
 	unsigned long flags;
 
 	if (timer->cpu == -1)
 		return 0;
 
 	timer->stop = 1;
-	ASSERT(timer->raw_timer != NULL);
-	spin_lock_irqsave(&timers->lock, flags);
+again:
+	timers = lock_timer_base(timer, &flags);
+	if (!timers)
+		return 0;
+
 	/*
 	 * wait the timer finish the action if already
-	 * timedout.
+	 * timedout, the lock is released when waiting since
+	 * the handler may re-arm the timer. if this is called
+	 * by the handler itself, do not wait.
 	 */
-	while (timers->running_timer == timer)
-		cpu_relax();
+	if ((timers->running_timer == timer) &&
+			(timers->cpu != smp_processor_id())) {
+		spin_unlock_irqrestore(&timers->lock, flags);
+		while (timers->running_timer == timer)
+			cpu_relax();
+		goto again;
+	}
 
 	detach_timer(timers, timer);
+
+	/*
+	 * if the timer is the next expired timer, find the new
+	 * one, and if the timer is on this pcpu, reprogram the
+	 * hardware timer to avoid the useless timer interrupt.
+	 */
+	if (timers->next_timer == timer) {
+		timers->next_timer = find_next_timer(timers);
+		pcpus[timers->cpu].nr_timer_reprogram++;
+		if (timers->cpu == smp_processor_id())
+			enable_timer(timers->next_timer ?
+					timers->next_timer->expires : 0);
+	}
+
 	timer->cpu = -1;
 	timer->expires = 0;
 	spin_unlock_irqrestore(&timers->lock, flags);
@@ -247,13 +720,21 @@ int stop_timer(struct timer *timer)
 static int init_raw_timers(void)
 {
 	struct raw_timer *timers;
-	int i;
+	int i, lvl, idx;
 
 	for (i = 0; i < CONFIG_NR_CPUS; i++) {
 		timers = &get_per_cpu(timers, i);
-		init_list(&timers->active);
+		for (lvl = 0; lvl < TIMER_LVL_DEPTH; lvl++) {
+			for (idx = 0; idx < TIMER_LVL_SIZE; idx++)
+				init_list(&timers->wheel[lvl][idx]);
+			timers->pending_map[lvl] = 0;
+		}
+		timers->cpu = i;
+		timers->clk = 0;
+		timers->nr_pending = 0;
 		timers->next_timer = NULL;
 		timers->running_timer = NULL;
+		timers->reprogram = 0;
 		spin_lock_init(&timers->lock);
 	}
 
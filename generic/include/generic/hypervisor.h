@@ -21,7 +21,9 @@
 #define VM_FLAGS_NO_OF_RESOURCE		(1 << 7)
 #define VM_FLAGS_CAN_RESET		(1 << 8)
 #define VM_FLAGS_HOST			(1 << 9)
+#define VM_FLAGS_GANG_SCHED		(1 << 10)
 #define VM_FLAGS_XNU_APPLE		(1 << 12)
+#define VM_FLAGS_DEMAND_PAGING		(1 << 13)
 
 #define VM_FLAGS_SETUP_OF		(1 << 16)
 #define VM_FLAGS_SETUP_ACPI		(1 << 17)
@@ -57,6 +59,13 @@ struct vmtag {
 
 	uint64_t initrd_base;
 	uint64_t initrd_size;
+
+	/*
+	 * weight and cap (percent of one pcpu) of each vcpu
+	 * of this VM, 0 means use the default value.
+	 */
+	uint32_t sched_weight;
+	uint32_t sched_cap;
 };
 
 #define IOCTL_CREATE_VM			0xf000
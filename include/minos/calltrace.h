@@ -5,6 +5,7 @@
 
 void __panic(gp_regs *regs, char *str, ...) __noreturn;
 void print_symbol(unsigned long addr);
+char *lookup_symbol(unsigned long addr, unsigned long *offset);
 void dump_stack(gp_regs *regs, unsigned long *stack);
 
 #define panic(...)	__panic(NULL, __VA_ARGS__)
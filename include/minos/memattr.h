@@ -16,6 +16,7 @@
 #define __VM_HOST		(0x00002000)
 #define __VM_GUEST		(0x00004000)
 #define __VM_SHMEM		(0x00008000)	/* prviate memory, will not be shared */
+#define __VM_DEMAND		(0x00010000)	/* memory block is allocated when first accessed */
 
 #define __VM_RW_NON		(0x00000000)
 #define __VM_READ		(0x00100000)
@@ -47,6 +48,7 @@
 #define VM_SHMEM		(__VM_SHMEM)
 #define VM_PFNMAP		(__VM_PFNMAP)
 #define VM_DEVMAP		(__VM_DEVMAP)
+#define VM_DEMAND		(__VM_DEMAND)
 
 #define VM_MAP_BK		(0X01000000)	/* mapped as block */
 #define VM_MAP_PT		(0x02000000)	/* mapped as pass though, PFN_MAP */
@@ -9,11 +9,31 @@
 #define pfn2phy(pfn) ((unsigned long)(pfn) << PAGE_SHIFT)
 #define phy2pfn(addr) ((unsigned long)(addr) >> PAGE_SHIFT)
 
+#define KMEM_CACHE_NAME_SIZE	20
+
+struct kmem_cache;
+
 void *malloc(size_t size);
 void *zalloc(size_t size);
 void free(void *addr);
 void free_pages(void *addr);
 void *__get_free_pages(int pages, int align);
+void dump_page_info(void);
+
+struct kmem_cache *kmem_cache_create(const char *name,
+		size_t size, void (*ctor)(void *obj));
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void *kmem_cache_zalloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+void dump_slab_info(void);
+void mm_reclaim(void);
+void mm_heap_shrink(void);
+
+#ifdef CONFIG_MM_PROFILE
+void mm_profile_dump(int top);
+void mm_profile_mark(void);
+void mm_profile_leak(int max);
+#endif
 
 static inline void *get_free_page(void)
 {
@@ -6,6 +6,7 @@
 #include <minos/arch.h>
 #include <minos/preempt.h>
 #include <minos/flag.h>
+#include <minos/cpumask.h>
 
 typedef enum {
 	PCPU_STATE_OFFLINE	= 0x0,
@@ -24,17 +25,18 @@ struct pcpu {
 	unsigned long percpu_offset;
 
 	/*
-	 * each pcpu has its local sched list, 8 priority
-	 * local_rdy_grp only use [0 - 8], in these 8
-	 * priority:
-	 * 7 - used for idle task
-	 * 6 - used for vcpu task
+	 * each pcpu has its local sched list, 64 priority,
+	 * each bit of local_rdy_grp means one group of 8
+	 * priority has ready task, and local_rdy_tbl[grp]
+	 * means which priority in this group has ready task.
+	 * 63 - used for idle task
 	 *
-	 * only the new_list can be changed by other cpu, the
-	 * lock is for the new_list.
+	 * only the wake_list can be changed by other cpu, it
+	 * is a lock free single linked list, other pcpu push
+	 * the task to it, and this pcpu take all the tasks
+	 * in the irqwork handler.
 	 */
-	spinlock_t lock;
-	struct list_head new_list;
+	struct task *wake_list;
 
 	struct list_head stop_list;
 	struct task *running_task;
@@ -42,13 +44,109 @@ struct pcpu {
 	uint32_t nr_pcpu_task;
 
 	uint8_t local_rdy_grp;
-	uint8_t padding[3];
+	uint8_t local_rdy_tbl[OS_PRIO_MAX / 8];
 	struct list_head ready_list[OS_PRIO_MAX];
 	int tasks_in_prio[OS_PRIO_MAX];
 
 	struct timer sched_timer;
 	int os_is_running;
 
+	/*
+	 * load information used to select a pcpu for the
+	 * task which do not have affinity:
+	 * nr_ready - runnable task on this pcpu, include the
+	 *            running one and the one in wake_list, but
+	 *            not include the idle task.
+	 * nr_movable - the tasks in nr_ready which do not have
+	 *              affinity, they can be moved by the balance.
+	 * load_ns  - the non-idle run time of this pcpu, it will
+	 *            decay by half for each PCPU_LOAD_PERIOD.
+	 */
+	atomic_t nr_ready;
+	atomic_t nr_movable;
+	unsigned long load_ns;
+	unsigned long load_stamp;
+
+	/*
+	 * steal_cpu - the pcpu which request to pull a task
+	 * from this pcpu, -1 means no request. the request is
+	 * handled in the irqwork handler of this pcpu, then the
+	 * task is pushed to the wake_list of the requester.
+	 */
+	int steal_cpu;
+	unsigned long nr_migrate_out;
+	atomic_t nr_migrate_in;
+
+	/*
+	 * wake_batch - nested count of wakeup_batch_begin(), in
+	 * the batch the irqwork to other pcpu is delayed until
+	 * wakeup_batch_end() and recorded in wake_kick.
+	 */
+	int wake_batch;
+	cpumask_t wake_kick;
+	unsigned long nr_remote_wake;
+	unsigned long nr_wake_ipi;
+	unsigned long nr_wake_deferred;
+
+	/*
+	 * nohz_full pcpu is dedicated for the vcpu pinned on
+	 * it, no unpinned task will be placed on it and the
+	 * deferrable timers armed on it will be moved to the
+	 * housekeeping pcpu.
+	 */
+	int nohz_full;
+	unsigned long nr_timer_irq;
+
+	/*
+	 * nr_timer_reprogram - the hardware timer is reprogrammed
+	 *                      when a timer is armed or stopped.
+	 * nr_reprogram_saved - the armed timer joined the pending
+	 *                      hardware timer by its slack.
+	 * nr_timer_coalesced - the timer expired in the interrupt
+	 *                      of other timer.
+	 */
+	unsigned long nr_timer_reprogram;
+	unsigned long nr_reprogram_saved;
+	unsigned long nr_timer_coalesced;
+	unsigned long nr_idle_enter;
+	unsigned long idle_ns;
+
+	/*
+	 * busy_ns is the run time of the non-idle tasks, wait_ns
+	 * is the time the tasks wait in the ready list, lat_hist
+	 * is the log2 histogram of the wakeup latency in us.
+	 */
+	unsigned long busy_ns;
+	unsigned long wait_ns;
+	unsigned long nr_preempt;
+	uint32_t lat_hist[SCHED_LAT_BUCKETS];
+
+	/*
+	 * bandwidth reserved by the deadline tasks pinned on
+	 * this pcpu, runtime / period << DL_BW_SHIFT.
+	 */
+	unsigned long dl_bw;
+
+	/*
+	 * the tasks scheduled by credit on this pcpu, and the
+	 * sum of their weight, credit_timer is only running
+	 * when there is credit task running on this pcpu.
+	 */
+	struct list_head credit_list;
+	unsigned long credit_weight;
+	struct timer credit_timer;
+	int credit_ticks;
+	int credit_active;
+
+	/*
+	 * the gang tasks pinned on this pcpu, gang_timer fires
+	 * at each slot boundary to boost the tasks of the gang
+	 * which own the slot.
+	 */
+	struct list_head gang_list;
+	struct timer gang_timer;
+	int gang_active;
+
 	struct task *kworker;
 	struct flag_grp kworker_flag;
 } __cache_line_align;
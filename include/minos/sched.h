@@ -8,6 +8,19 @@
 
 DECLARE_PER_CPU(struct pcpu *, pcpu);
 
+/*
+ * pcpu0 always do the housekeeping work, it can not
+ * be set to nohz_full mode.
+ */
+#define HOUSEKEEPING_CPU	0
+
+/*
+ * the bandwidth of deadline task is runtime / period in
+ * fixed point, 1 << DL_BW_SHIFT means the whole pcpu.
+ */
+#define DL_BW_SHIFT		20
+#define DL_BW_UNIT		(1UL << DL_BW_SHIFT)
+
 struct process;
 
 void pcpus_init(void);
@@ -21,6 +34,20 @@ void task_sleep(uint32_t ms);
 void irq_enter(gp_regs *regs);
 void irq_exit(gp_regs *regs);
 int task_ready(struct task *task, int preempt);
+unsigned long pcpu_recent_load(int cpu);
+int pcpu_nr_ready(int cpu);
+void sched_idle_balance(void);
+void wakeup_batch_begin(void);
+void wakeup_batch_end(void);
+int task_set_deadline(struct task *task, unsigned long runtime,
+		unsigned long deadline, unsigned long period);
+void task_clear_deadline(struct task *task);
+int task_set_credit(struct task *task, int weight, int cap);
+void task_clear_credit(struct task *task);
+int sched_gang_alloc(void);
+void sched_gang_free(int gang);
+int task_join_gang(struct task *task, int gang);
+void task_leave_gang(struct task *task);
 
 void __might_sleep(const char *file, int line, int preempt_offset);
 
@@ -41,6 +68,45 @@ static inline int wake_up_abort(struct task *task)
 	return __wake_up(task, TASK_STATE_PEND_ABORT, 0, NULL);
 }
 
+static inline int pcpu_is_nohz_full(int cpu)
+{
+	return pcpus[cpu].nohz_full;
+}
+
+static inline void pcpu_set_prio_ready(struct pcpu *pcpu, int prio)
+{
+	pcpu->local_rdy_tbl[OS_PRIO_GRP(prio)] |= BIT(OS_PRIO_BIT(prio));
+	pcpu->local_rdy_grp |= BIT(OS_PRIO_GRP(prio));
+}
+
+static inline void pcpu_clear_prio_ready(struct pcpu *pcpu, int prio)
+{
+	int grp = OS_PRIO_GRP(prio);
+
+	pcpu->local_rdy_tbl[grp] &= ~BIT(OS_PRIO_BIT(prio));
+	if (pcpu->local_rdy_tbl[grp] == 0)
+		pcpu->local_rdy_grp &= ~BIT(grp);
+}
+
+static inline int pcpu_prio_ready(struct pcpu *pcpu, int prio)
+{
+	return !!(pcpu->local_rdy_tbl[OS_PRIO_GRP(prio)] & BIT(OS_PRIO_BIT(prio)));
+}
+
+/*
+ * get the highest ready prio of the pcpu in constant
+ * time, -1 if there is no ready task.
+ */
+static inline int pcpu_highest_prio(struct pcpu *pcpu)
+{
+	int grp = ffs_one_table[pcpu->local_rdy_grp];
+
+	if (grp < 0)
+		return -1;
+
+	return OS_PRIO(grp, ffs_one_table[pcpu->local_rdy_tbl[grp]]);
+}
+
 #define might_sleep() \
 	do { \
 		__might_sleep(__FILE__, __LINE__, 0); \
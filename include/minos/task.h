@@ -44,6 +44,16 @@ static inline int task_is_vcpu(struct task *task)
 	return (task->flags & TASK_FLAGS_VCPU);
 }
 
+static inline int task_is_dl(struct task *task)
+{
+	return (task->dl.runtime != 0);
+}
+
+static inline int task_is_credit(struct task *task)
+{
+	return (task->credit.weight != 0);
+}
+
 static inline int task_is_32bit(struct task *task)
 {
 	return (task->flags & TASK_FLAGS_32BIT);
@@ -119,5 +129,7 @@ struct task *create_vcpu_task(char *name, task_func_t func, int aff,
 
 void os_for_all_task(void (*hdl)(struct task *task));
 
+void task_migrate_timers(struct task *task, int cpu);
+
 #endif
 
@@ -20,21 +20,36 @@
 
 #define OS_NR_TASKS CONFIG_NR_TASKS
 
-#define OS_PRIO_MAX		8
-#define OS_PRIO_DEFAULT_0	0
-#define OS_PRIO_DEFAULT_1	1
-#define OS_PRIO_DEFAULT_2	2
-#define OS_PRIO_DEFAULT_3	3
-#define OS_PRIO_DEFAULT_4	4
-#define OS_PRIO_DEFAULT_5	5
-#define OS_PRIO_DEFAULT_6	6
-#define OS_PRIO_DEFAULT_7	7
+/*
+ * 64 priorities, split into 8 groups and each group has
+ * 8 priorities, the scheduler use a two level bitmap to
+ * find the highest ready priority:
+ * prio = (group << OS_PRIO_GRP_SHIFT) | bit
+ */
+#define OS_PRIO_MAX		64
+#define OS_PRIO_GRP_SHIFT	3
+#define OS_PRIO_GRP_NR		(OS_PRIO_MAX >> OS_PRIO_GRP_SHIFT)
+#define OS_PRIO_GRP(prio)	((prio) >> OS_PRIO_GRP_SHIFT)
+#define OS_PRIO_BIT(prio)	((prio) & ((1 << OS_PRIO_GRP_SHIFT) - 1))
+#define OS_PRIO(grp, bit)	(((grp) << OS_PRIO_GRP_SHIFT) | (bit))
+
+#define OS_PRIO_DEFAULT_0	OS_PRIO(0, 0)
+#define OS_PRIO_DEFAULT_1	OS_PRIO(1, 0)
+#define OS_PRIO_DEFAULT_2	OS_PRIO(2, 0)
+#define OS_PRIO_DEFAULT_3	OS_PRIO(3, 0)
+#define OS_PRIO_DEFAULT_4	OS_PRIO(4, 0)
+#define OS_PRIO_DEFAULT_5	OS_PRIO(5, 0)
+#define OS_PRIO_DEFAULT_6	OS_PRIO(6, 0)
+#define OS_PRIO_DEFAULT_7	OS_PRIO(7, 0)
 
 #define OS_PRIO_REALTIME	OS_PRIO_DEFAULT_0
+#define OS_PRIO_DEADLINE	OS_PRIO(0, 1)
 #define OS_PRIO_SYSTEM		OS_PRIO_DEFAULT_3
 #define OS_PRIO_VCPU		OS_PRIO_DEFAULT_4
+#define OS_PRIO_VCPU_GANG	(OS_PRIO_VCPU - 1)
+#define OS_PRIO_VCPU_OVER	OS_PRIO(4, 1)
 #define OS_PRIO_DEFAULT		OS_PRIO_DEFAULT_5
-#define OS_PRIO_IDLE		OS_PRIO_DEFAULT_7
+#define OS_PRIO_IDLE		(OS_PRIO_MAX - 1)
 #define OS_PRIO_LOWEST		OS_PRIO_IDLE
 
 #define TASK_FLAGS_VCPU			BIT(0)
@@ -63,6 +78,8 @@
 
 #define KWORKER_FLAG_MASK	0xffff
 #define KWORKER_TASK_RECYCLE	BIT(0)
+#define KWORKER_MM_RECLAIM	BIT(1)
+#define KWORKER_HEAP_SHRINK	BIT(2)
 
 #define TASK_TIMEOUT_CLEAR	0x0
 #define TASK_TIMEOUT_REQUESTED	0x1
@@ -75,6 +92,62 @@ typedef int (*task_func_t)(void *data);
 
 struct process;
 
+/*
+ * deadline (EDF + CBS) parameters of a task, the time is
+ * in ns, runtime == 0 means this is not a deadline task.
+ * budget    - the runtime left in the current period.
+ * timer     - enforce the budget when the task is running,
+ *             and replenish the budget when it is throttled.
+ */
+struct task_dl {
+	unsigned long runtime;
+	unsigned long deadline;
+	unsigned long period;
+	unsigned long bw;
+	unsigned long abs_deadline;
+	long budget;
+	unsigned long nr_miss;
+	unsigned long nr_throttle;
+	struct timer timer;
+};
+
+/*
+ * scheduler statistics of the task, the time is in ns.
+ * ready_stamp - when the task is put to the ready list.
+ * woken       - the task is waked up, not preempted.
+ * lat_hist    - log2 histogram of the wakeup to run latency
+ *               in us, bucket n is [2^(n-1), 2^n) us.
+ */
+struct task_stat {
+	unsigned long run_ns;
+	unsigned long wait_ns;
+	unsigned long ready_stamp;
+	unsigned long nr_preempt;
+	int woken;
+	uint32_t lat_hist[SCHED_LAT_BUCKETS];
+};
+
+/*
+ * credit of a vcpu task, the credit is given to the tasks
+ * on the same pcpu by weight each accounting period, and
+ * used when the task is running, weight == 0 means the
+ * task is not scheduled by credit.
+ * cap      - max percent of one pcpu the task can use in
+ *            one period, 0 means no cap.
+ * stamp    - the last time the run time is accounted.
+ * entitled - the total credit given to this task.
+ */
+struct task_credit {
+	int weight;
+	int cap;
+	long credit;
+	unsigned long stamp;
+	unsigned long run_ns;
+	unsigned long entitled_ns;
+	unsigned long nr_park;
+	struct list_head list;
+};
+
 #ifdef CONFIG_VIRT
 struct vcpu;
 #endif
@@ -92,6 +165,7 @@ struct task {
 
 	struct list_head task_list;	// link to the task list, if is a thread.
 	struct list_head state_list;	// link to the sched list used for sched.
+	struct task *wake_next;		// link to the wake_list of the target pcpu.
 
 	uint32_t delay;
 	struct timer delay_timer;
@@ -124,9 +198,37 @@ struct task {
 	int affinity;
 	int prio;
 
+	/*
+	 * set when other cpu wake up the task but it is still
+	 * switching out, the cpu which run the task will finish
+	 * the wakeup.
+	 */
+	int wake_pending;
+
+	/*
+	 * the task used up its deadline budget or its capped
+	 * credit, it is removed from the ready list until the
+	 * budget or credit is given again.
+	 */
+	int throttled;
+
+	/*
+	 * the tasks in the same gang are boosted to the
+	 * OS_PRIO_VCPU_GANG in the same slot on all the pcpus,
+	 * gang_prio is the prio before boosted.
+	 */
+	int gang;
+	int gang_boost;
+	int gang_prio;
+	struct list_head gang_list;
+
 	unsigned long run_time;
+	struct task_dl dl;
+	struct task_credit credit;
+	struct task_stat stat;
 
 	unsigned long ctx_sw_cnt;	// switch count of this task.
+	unsigned long migrate_cnt;	// how many times moved to other pcpu.
 	unsigned long start_ns;		// when the task started last time.
 
 	char name[TASK_NAME_SIZE];
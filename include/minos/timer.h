@@ -8,11 +8,54 @@
 
 typedef void (*timer_func_t)(unsigned long);
 
+/*
+ * deferrable timer is not time critical, when it is armed
+ * on a nohz_full pcpu, it will be queued on the housekeeping
+ * pcpu.
+ */
+#define TIMER_DEFERRABLE	(1 << 0)
+
+/*
+ * high resolution timer expires in us granularity instead
+ * of the 1ms TIMER_PRECISION, used for the guest timers.
+ */
+#define TIMER_HRES		(1 << 1)
+
+/*
+ * the pending timers of each pcpu are hashed into a
+ * hierarchical timing wheel, each level has 64 slots and
+ * one slot of level n covers 64^n ticks of the level 0,
+ * the tick of level 0 is 2^TIMER_WHEEL_TICK_SHIFT ns. the
+ * timer is queued to the slot by its expires, the timer
+ * in the higher level is cascaded to the lower level when
+ * the wheel turns to it.
+ */
+#define TIMER_WHEEL_TICK_SHIFT	20
+#define TIMER_LVL_BITS		6
+#define TIMER_LVL_SIZE		(1 << TIMER_LVL_BITS)
+#define TIMER_LVL_MASK		(TIMER_LVL_SIZE - 1)
+#define TIMER_LVL_DEPTH		4
+
+#ifdef CONFIG_TIMER_SLACK
+#define TIMER_SLACK_DEFAULT	(CONFIG_TIMER_SLACK * 1000UL)
+#else
+#define TIMER_SLACK_DEFAULT	0
+#endif
+
+/*
+ * slack - the timer may expire up to slack ns later than
+ *         expires, the expires is moved in this window to
+ *         share the hardware timer interrupt with other
+ *         timers, 0 means the timer need exact expiry.
+ */
 struct timer {
 	int cpu;
 	int stop;
+	int slot;
+	unsigned long flags;
 	uint64_t expires;
 	uint64_t timeout;
+	uint64_t slack;
 	timer_func_t function;
 	unsigned long data;
 	struct list_head entry;
@@ -22,16 +65,31 @@ struct timer {
 /*
  * raw timer is a hardware timer which use to
  * handle timer request.
+ * cpu         - the pcpu which own this raw timer.
+ * clk         - the tick of level 0 the wheel turned to.
+ * pending_map - which slot of each level has timer.
+ * reprogram   - other pcpu queued the first timer to expire,
+ *               the hardware timer is reprogrammed in the
+ *               irqwork handler of the owner pcpu.
  */
 struct raw_timer {
-	struct list_head active;
+	int cpu;
+	unsigned long clk;
+	unsigned long pending_map[TIMER_LVL_DEPTH];
+	struct list_head wheel[TIMER_LVL_DEPTH][TIMER_LVL_SIZE];
+	int nr_pending;
 	struct timer *next_timer;
 	struct timer *running_timer;
+	int reprogram;
 	spinlock_t lock;
 };
 
 void init_timer(struct timer *timer, timer_func_t fn,
 		unsigned long data);
+void init_deferrable_timer(struct timer *timer, timer_func_t fn,
+		unsigned long data);
+void init_hres_timer(struct timer *timer, timer_func_t fn,
+		unsigned long data);
 
 int start_timer(struct timer *timer);
 int stop_timer(struct timer *timer);
@@ -39,5 +97,9 @@ int read_timer(struct timer *timer);
 void setup_timer(struct timer *timer, uint64_t tval);
 void setup_and_start_timer(struct timer *timer, uint64_t tval);
 int mod_timer(struct timer *timer, uint64_t cval);
+int mod_timer_on(struct timer *timer, uint64_t cval, int cpu);
+int migrate_timer(struct timer *timer, int cpu);
+void set_timer_slack(struct timer *timer, uint64_t slack);
+void timer_irqwork(void);
 
 #endif
@@ -170,7 +170,9 @@ typedef void (*void_func_t)(void);
 
 #define BAD_ADDRESS (-1)
 
-#define OS_PRIO_MAX 8
+#define OS_PRIO_MAX 64
+
+#define SCHED_LAT_BUCKETS 16
 
 extern int8_t const ffs_one_table[256];
 
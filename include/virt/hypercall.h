@@ -32,6 +32,11 @@
 #define HVC_VM_VIRTIO_MMIO_DEINIT	HVC_VM0_FN(12)
 #define HVC_VM_CREATE_RESOURCE		HVC_VM0_FN(13)
 #define HVC_CHANGE_LOG_LEVEL		HVC_VM0_FN(14)
+#define HVC_VM_SET_SCHED		HVC_VM0_FN(15)
+#define HVC_VM_GET_SCHED_STAT		HVC_VM0_FN(16)
+#define HVC_SCHED_GET_PCPU_STAT		HVC_VM0_FN(17)
+#define HVC_SCHED_GET_VCPU_STAT		HVC_VM0_FN(18)
+#define HVC_SCHED_GET_LAT_HIST		HVC_VM0_FN(19)
 
 #define HVC_GET_VMID			HVC_MISC_FN(0)
 #define HVC_SCHED_OUT			HVC_MISC_FN(1)
@@ -17,6 +17,8 @@
 
 #define VM_MAX_VCPU CONFIG_NR_CPUS
 
+#define VM_SCHED_WEIGHT_DEFAULT	256
+
 #define VM_STATE_OFFLINE (0)
 #define VM_STATE_FREEZEING (1)
 #define VM_STATE_ONLINE (2)
@@ -102,6 +104,13 @@ struct vm {
 
 	unsigned long time_offset;
 
+	/*
+	 * credit scheduler parameters of the vcpus.
+	 */
+	uint32_t sched_weight;
+	uint32_t sched_cap;
+	int gang_id;
+
 	struct list_head vdev_list;
 
 	uint32_t vspi_nr;
@@ -190,6 +199,7 @@ int vcpu_power_on(struct vcpu *caller, unsigned long affinity,
 		unsigned long entry, unsigned long unsed);
 int vcpu_power_off(struct vcpu *vcpu, int timeout);
 int kick_vcpu(struct vcpu *vcpu, int preempt);
+void vcpu_migrate_timers(struct vcpu *vcpu, int cpu);
 
 struct vm *create_vm(struct vmtag *vme, struct device_node *node);
 int create_guest_vm(struct vmtag *tag);
@@ -224,6 +234,10 @@ static inline int vm_id(struct vm *vm)
 	return vm->vmid;
 }
 
+int vm_set_sched_param(struct vm *vm, int weight, int cap);
+void vm_get_sched_stat(struct vm *vm, unsigned long *run_ns,
+		unsigned long *entitled_ns);
+
 int create_vm_mmap(int vmid,  unsigned long offset,
 		unsigned long size, unsigned long *addr);
 int vm_create_host_vdev(struct vm *vm);
@@ -53,6 +53,12 @@ struct mm_struct {
 	 */
 	struct list_head vmm_area_free;
 	struct list_head vmm_area_used;
+
+	/*
+	 * the memory blocks allocated for the VM_MAP_BK vmm_area,
+	 * for the on demand vmm_area it is the resident memory.
+	 */
+	unsigned long nr_mem_blocks;
 };
 
 int vm_mm_init(struct vm *vm);
@@ -62,6 +68,9 @@ int copy_from_guest(void *target, void __guest *source, size_t size);
 
 int alloc_vm_memory(struct vm *vm);
 void release_vm_memory(struct vm *vm);
+int vm_demand_fault(struct vm *vm, unsigned long ipa);
+void vm_mem_usage(struct vm *vm, unsigned long *total,
+		unsigned long *resident);
 
 int create_guest_mapping(struct mm_struct *mm, unsigned long vir,
 		unsigned long phy, size_t size, unsigned long flags);
@@ -93,8 +102,11 @@ struct vmm_area *alloc_free_vmm_area(struct mm_struct *mm,
 int unmap_vmm_area(struct mm_struct *mm, struct vmm_area *va);
 
 struct mem_block *vmm_alloc_memblock(void);
+struct mem_block *vmm_alloc_memblock_run(void);
 int vmm_free_memblock(struct mem_block *mb);
 int vmm_has_enough_memory(size_t size);
+unsigned long vmm_borrow_memblock(void);
+void vmm_return_memblock(unsigned long base);
 
 int release_vmm_area(struct mm_struct *mm, struct vmm_area *va);
 
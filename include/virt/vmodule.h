@@ -26,6 +26,8 @@ struct vmodule {
 	 * state_stop - stop the state when the vcpu is stop
 	 * state_suspend - suspend the state when the vcpu suspend
 	 * state_resume - resume the state when the vcpu is resume
+	 * state_migrate - move the state such as timers when the
+	 *                 vcpu is moved to other pcpu
 	 */
 	void (*state_save)(struct vcpu *vcpu, void *context);
 	void (*state_restore)(struct vcpu *vcpu, void *context);
@@ -36,6 +38,7 @@ struct vmodule {
 	void (*state_suspend)(struct vcpu *vcpu, void *context);
 	void (*state_resume)(struct vcpu *vcpu, void *context);
 	void (*state_dump)(struct vcpu *vcpu, void *context);
+	void (*state_migrate)(struct vcpu *vcpu, void *context, int cpu);
 };
 
 typedef int (*vmodule_init_fn)(struct vmodule *);
@@ -50,6 +53,7 @@ void suspend_vcpu_vmodule_state(struct vcpu *vcpu);
 void resume_vcpu_vmodule_state(struct vcpu *vcpu);
 void stop_vcpu_vmodule_state(struct vcpu *vcpu);
 void dump_vcpu_vmodule_state(struct vcpu *vcpu);
+void migrate_vcpu_vmodule_state(struct vcpu *vcpu, int cpu);
 
 void *get_vmodule_data_by_id(struct vcpu *vcpu, int id);
 int register_vcpu_vmodule(const char *name, vmodule_init_fn fn);
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 Min Le (lemin9538@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <minos/minos.h>
+#include <minos/mm.h>
+#include <minos/shell_command.h>
+
+static int mem_cmd(int argc, char **argv)
+{
+	dump_page_info();
+	printf("\n");
+	dump_slab_info();
+
+	return 0;
+}
+DEFINE_SHELL_COMMAND(mem, "mem", "Show the memory allocator information", mem_cmd, 0);
+
+#ifdef CONFIG_MM_PROFILE
+/*
+ * memprof [top]     - the call sites hold the most memory.
+ * memprof mark      - mark the objects allocated from now.
+ * memprof leak [nr] - the objects allocated after the mark
+ *                     and still live.
+ */
+static int memprof_cmd(int argc, char **argv)
+{
+	int nr;
+
+	if ((argc > 1) && !strcmp(argv[1], "mark")) {
+		mm_profile_mark();
+		return 0;
+	}
+
+	if ((argc > 1) && !strcmp(argv[1], "leak")) {
+		nr = (argc > 2) ? atoi(argv[2]) : 32;
+		mm_profile_leak(nr);
+		return 0;
+	}
+
+	nr = (argc > 1) ? atoi(argv[1]) : 16;
+	if (nr <= 0)
+		return -EINVAL;
+
+	mm_profile_dump(nr);
+
+	return 0;
+}
+DEFINE_SHELL_COMMAND(memprof, "memprof", "Show the heap allocation call sites", memprof_cmd, 0);
+#endif
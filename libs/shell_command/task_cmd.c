@@ -15,6 +15,7 @@
  */
 
 #include <minos/task.h>
+#include <minos/sched.h>
 #include <minos/shell_command.h>
 #include <virt/vm.h>
 
@@ -70,3 +71,176 @@ static int ps_cmd(int argc, char **argv)
 	return 0;
 }
 DEFINE_SHELL_COMMAND(ps, "ps", "List all task information", ps_cmd, 0);
+
+static char *pcpu_state_str[3] = {
+	"Offline",
+	"Running",
+	"   Idle",
+};
+
+static void dump_task_placement(struct task *task)
+{
+	int cpu;
+
+	if (task->affinity != TASK_AFF_ANY)
+		return;
+
+	cpu = (task->cpu != -1) ? task->cpu : task->last_cpu;
+	printf("%4d %3d %s %7d %s\n", task->tid, cpu,
+			get_state_str(task), task->migrate_cnt, task->name);
+}
+
+static void dump_task_deadline(struct task *task)
+{
+	struct task_dl *dl = &task->dl;
+
+	if (!task_is_dl(task))
+		return;
+
+	printf("%4d %3d %9ld %9ld %9ld %7ld %8ld %s\n", task->tid,
+			task->affinity, dl->runtime / 1000,
+			dl->deadline / 1000, dl->period / 1000,
+			dl->nr_miss, dl->nr_throttle, task->name);
+}
+
+static int sched_cmd(int argc, char **argv)
+{
+	struct pcpu *pcpu;
+	int cpu;
+
+	printf(" CPU   STATE READY  LOAD(us)  MIG-IN MIG-OUT RUNNING\n");
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		printf("%4d %s %5d %9ld %7d %7ld %s\n", cpu,
+				pcpu_state_str[pcpu->state],
+				pcpu_nr_ready(cpu),
+				pcpu_recent_load(cpu) / 1000,
+				atomic_read(&pcpu->nr_migrate_in),
+				pcpu->nr_migrate_out,
+				pcpu->running_task ? pcpu->running_task->name : "-");
+	}
+
+	printf("\n CPU NOHZ TIMER-IRQ  IDLE-CNT  IDLE(ms)\n");
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		printf("%4d %4s %9ld %9ld %9ld\n", cpu,
+				pcpu->nohz_full ? "full" : "-",
+				pcpu->nr_timer_irq, pcpu->nr_idle_enter,
+				pcpu->idle_ns / 1000000);
+	}
+
+	printf("\n CPU REPROGRAM     SAVED COALESCED\n");
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		printf("%4d %9ld %9ld %9ld\n", cpu,
+				pcpu->nr_timer_reprogram,
+				pcpu->nr_reprogram_saved,
+				pcpu->nr_timer_coalesced);
+	}
+
+	printf("\n CPU  RMT-WAKE  WAKE-IPI  DEFERRED\n");
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		printf("%4d %9ld %9ld %9ld\n", cpu,
+				pcpu->nr_remote_wake, pcpu->nr_wake_ipi,
+				pcpu->nr_wake_deferred);
+	}
+
+	printf("\n PID CPU   STATE MIGRATE NAME\n");
+	os_for_all_task(dump_task_placement);
+
+	printf("\n CPU  DL-BW(%%)\n");
+	for_each_online_cpu(cpu) {
+		printf("%4d %9ld\n", cpu,
+			(pcpus[cpu].dl_bw * 100) >> DL_BW_SHIFT);
+	}
+
+	printf("\n PID CPU   RUN(us)    DL(us)   PER(us)"
+			"  MISSED THROTTLE NAME\n");
+	os_for_all_task(dump_task_deadline);
+
+	return 0;
+}
+DEFINE_SHELL_COMMAND(sched, "sched", "Show pcpu load and task placement", sched_cmd, 0);
+
+extern struct task *os_task_table[OS_NR_TASKS];
+
+static void dump_lat_hist(uint32_t *hist)
+{
+	int i;
+
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		printf(" %6d", hist[i]);
+	printf("\n");
+}
+
+static void dump_lat_hist_head(char *name)
+{
+	int i;
+
+	printf("%4s", name);
+	for (i = 0; i < SCHED_LAT_BUCKETS - 1; i++)
+		printf(" %6d", 1 << i);
+	printf("   more\n");
+}
+
+static void dump_task_stat(struct task *task)
+{
+	struct task_stat *st = &task->stat;
+
+	printf("%4d %9ld %9ld %8ld %8ld %s\n", task->tid,
+			st->run_ns / 1000000, st->wait_ns / 1000000,
+			st->nr_preempt, task->ctx_sw_cnt, task->name);
+}
+
+static int schedstat_cmd(int argc, char **argv)
+{
+	struct task *task;
+	struct pcpu *pcpu;
+	int cpu, tid;
+
+	/*
+	 * schedstat <tid> show the wakeup latency histogram
+	 * of the task.
+	 */
+	if (argc > 1) {
+		tid = atoi(argv[1]);
+		if ((tid < 0) || (tid >= OS_NR_TASKS))
+			return -EINVAL;
+
+		task = os_task_table[tid];
+		if (!task || (task == OS_TASK_RESERVED))
+			return -ENOENT;
+
+		printf(" PID   RUN(ms)  WAIT(ms)  PREEMPT   SWITCH NAME\n");
+		dump_task_stat(task);
+		printf("\nwakeup latency (us)\n");
+		dump_lat_hist_head(" PID");
+		printf("%4d", task->tid);
+		dump_lat_hist(task->stat.lat_hist);
+
+		return 0;
+	}
+
+	printf(" CPU  BUSY(ms)  WAIT(ms)  PREEMPT\n");
+	for_each_online_cpu(cpu) {
+		pcpu = &pcpus[cpu];
+		printf("%4d %9ld %9ld %8ld\n", cpu,
+				pcpu->busy_ns / 1000000,
+				pcpu->wait_ns / 1000000,
+				pcpu->nr_preempt);
+	}
+
+	printf("\nwakeup latency (us)\n");
+	dump_lat_hist_head(" CPU");
+	for_each_online_cpu(cpu) {
+		printf("%4d", cpu);
+		dump_lat_hist(pcpus[cpu].lat_hist);
+	}
+
+	printf("\n PID   RUN(ms)  WAIT(ms)  PREEMPT   SWITCH NAME\n");
+	os_for_all_task(dump_task_stat);
+
+	return 0;
+}
+DEFINE_SHELL_COMMAND(schedstat, "schedstat", "Show the scheduler statistics", schedstat_cmd, 0);
@@ -25,10 +25,49 @@
 #include <virt/os.h>
 #include <virt/vm_pm.h>
 
+/*
+ * args[0] - the pcpu id or the vmid
+ * args[1] - the bucket of the latency histogram or the vcpu id
+ */
+static int sched_stat_hvc_handler(gp_regs *c, uint32_t id,
+		uint64_t *args, struct vm *vm)
+{
+	struct task_stat *st;
+	struct vcpu *vcpu;
+	struct pcpu *pcpu;
+
+	switch (id) {
+	case HVC_SCHED_GET_PCPU_STAT:
+		if (args[0] >= NR_CPUS)
+			break;
+		pcpu = &pcpus[args[0]];
+		HVC_RET4(c, 0, pcpu->busy_ns, pcpu->wait_ns, pcpu->nr_preempt);
+		break;
+	case HVC_SCHED_GET_VCPU_STAT:
+		if (!vm)
+			break;
+		vcpu = get_vcpu_in_vm(vm, (uint32_t)args[1]);
+		if (!vcpu)
+			break;
+		st = &vcpu->task->stat;
+		HVC_RET4(c, 0, st->run_ns, st->wait_ns, st->nr_preempt);
+		break;
+	case HVC_SCHED_GET_LAT_HIST:
+		if ((args[0] >= NR_CPUS) || (args[1] >= SCHED_LAT_BUCKETS))
+			break;
+		HVC_RET2(c, 0, pcpus[args[0]].lat_hist[args[1]]);
+		break;
+	default:
+		break;
+	}
+
+	HVC_RET1(c, -EINVAL);
+}
+
 static int vm_hvc_handler(gp_regs *c, uint32_t id, uint64_t *args)
 {
 	int vmid = -1, ret;
-	unsigned long addr;
+	unsigned long addr, run, entitled;
 	unsigned long hbase = 0;
 	struct vm *vm = get_vm_by_id((uint32_t)args[0]);
 
@@ -98,6 +137,20 @@ static int vm_hvc_handler(gp_regs *c, uint32_t id, uint64_t *args)
 	case HVC_CHANGE_LOG_LEVEL:
 		change_log_level((unsigned int)args[0]);
 		break;
+	case HVC_VM_SET_SCHED:
+		ret = vm_set_sched_param(vm, (int)args[1], (int)args[2]);
+		HVC_RET1(c, ret);
+		break;
+	case HVC_VM_GET_SCHED_STAT:
+		if (!vm)
+			HVC_RET1(c, -ENOENT);
+		vm_get_sched_stat(vm, &run, &entitled);
+		HVC_RET3(c, 0, run, entitled);
+		break;
+	case HVC_SCHED_GET_PCPU_STAT:
+	case HVC_SCHED_GET_VCPU_STAT:
+	case HVC_SCHED_GET_LAT_HIST:
+		return sched_stat_hvc_handler(c, id, args, vm);
 	default:
 		pr_err("unsupport vm hypercall");
 		break;
@@ -109,6 +109,8 @@ int parse_vm_info_of(struct device_node *node, struct vmtag *vmtag)
 	of_get_u32_array(node, "vcpu_affinity",
 			vmtag->vcpu_affinity, vmtag->nr_vcpu);
 	of_get_u64_array(node, "load-address", &vmtag->load_address, 1);
+	of_get_u32_array(node, "sched_weight", &vmtag->sched_weight, 1);
+	of_get_u32_array(node, "sched_cap", &vmtag->sched_cap, 1);
 
 	if (of_get_bool(node, "disabled")) {
 		pr_notice("vm%d [%s] disabled in dts\n", vmtag->vmid, vmtag->name);
@@ -127,6 +129,9 @@ int parse_vm_info_of(struct device_node *node, struct vmtag *vmtag)
 	if (of_get_bool(node, "host_vm"))
 		vmtag->flags |= VM_FLAGS_HOST;
 
+	if (of_get_bool(node, "gang_sched"))
+		vmtag->flags |= VM_FLAGS_GANG_SCHED;
+
 	vmtag->kernel_file = of_getprop(node, "kernel_image", NULL);
 	vmtag->dtb_file = of_getprop(node, "dtb_image", NULL);
 	vmtag->initrd_file = of_getprop(node, "initrd_image", NULL);
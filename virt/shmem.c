@@ -47,6 +47,7 @@ static uint16_t sbid;
 static DEFINE_SPIN_LOCK(shmem_lock);
 
 static struct shmem_block *shmem_blocks[MAX_SHMEM_ID];
+static struct kmem_cache *shmem_cache;
 
 static struct shmem_block *alloc_shmem_block(void)
 {
@@ -95,7 +96,7 @@ static void *__alloc_shmem(struct shmem_block *sb, int pages, int flags)
 	if (bits >= PAGES_IN_BLOCK)
 		return NULL;
 
-	shmem = malloc(sizeof(struct shmem));
+	shmem = kmem_cache_alloc(shmem_cache);
 	if (!shmem)
 		return NULL;
 
@@ -164,7 +165,7 @@ static void free_shmem_in_block(struct shmem *shmem)
 	pfn = phy2pfn(pfn2phy(shmem->pfn) - ULONG(sb->phy_base));
 	bitmap_clear(sb->bitmap, pfn, shmem->pages);
 	sb->free_pages += shmem->pages;
-	free(shmem);
+	kmem_cache_free(shmem_cache, shmem);
 }
 
 void free_shmem(void *addr)
@@ -194,3 +195,12 @@ void free_shmem(void *addr)
 
 	spin_unlock(&shmem_lock);
 }
+
+static int shmem_cache_init(void)
+{
+	shmem_cache = kmem_cache_create("shmem", sizeof(struct shmem), NULL);
+	ASSERT(shmem_cache != NULL);
+
+	return 0;
+}
+early_initcall(shmem_cache_init);
@@ -50,6 +50,7 @@ static DECLARE_BITMAP(vmid_bitmap, CONFIG_MAX_VM);
 
 static int aff_current;
 static int native_vcpus;
+static struct kmem_cache *vcpu_cache;
 DECLARE_BITMAP(vcpu_aff_bitmap, NR_CPUS);
 DEFINE_SPIN_LOCK(affinity_lock);
 
@@ -161,6 +162,16 @@ int vcpu_off(struct vcpu *vcpu)
 	return 0;
 }
 
+/*
+ * move all the timers owned by the vcpu to the pcpu, called
+ * when the vcpu is moved to the pcpu.
+ */
+void vcpu_migrate_timers(struct vcpu *vcpu, int cpu)
+{
+	task_migrate_timers(vcpu->task, cpu);
+	migrate_vcpu_vmodule_state(vcpu, cpu);
+}
+
 static int vm_check_vcpu_affinity(int vmid, uint32_t *aff, int nr)
 {
 	int i;
@@ -267,14 +278,14 @@ static void inline release_vcpu(struct vcpu *vcpu)
 	if (vcpu->virq_struct)
 		free(vcpu->virq_struct);
 
-	free(vcpu);
+	kmem_cache_free(vcpu_cache, vcpu);
 }
 
 static struct vcpu *alloc_vcpu(void)
 {
 	struct vcpu *vcpu;
 
-	vcpu = zalloc(sizeof(*vcpu));
+	vcpu = kmem_cache_zalloc(vcpu_cache);
 	if (!vcpu)
 		return NULL;
 
@@ -286,7 +297,7 @@ static struct vcpu *alloc_vcpu(void)
 	return vcpu;
 
 free_vcpu:
-	free(vcpu);
+	kmem_cache_free(vcpu_cache, vcpu);
 
 	return NULL;
 }
@@ -447,6 +458,11 @@ static int vmtag_check_and_config(struct vmtag *tag)
 	 * this vm and the vm's memory base need to be start
 	 * at 0x80000000 or higher, if the mem_base is 0,
 	 * then set it to default 0x80000000
+	 *
+	 * the memory is not reserved here, the on demand vm
+	 * gets its memory block when it touches the memory,
+	 * so the on demand vms may overcommit the memory and
+	 * the vcpu is faulted when there is no memory left.
 	 */
 	size = tag->mem_size;
 	if (tag->mem_base == 0)
@@ -562,7 +578,12 @@ int start_guest_vm(struct vm *vm)
 
 static int guest_mm_init(struct vm *vm, uint64_t base, uint64_t size)
 {
-	if (split_vmm_area(&vm->mm, base, size, VM_GUEST_NORMAL) == NULL) {
+	int flags = VM_GUEST_NORMAL;
+
+	if (vm->flags & VM_FLAGS_DEMAND_PAGING)
+		flags |= VM_DEMAND;
+
+	if (split_vmm_area(&vm->mm, base, size, flags) == NULL) {
 		pr_err("invalid memory config for guest VM\n");
 		return -EINVAL;
 	}
@@ -743,6 +764,9 @@ void destroy_vm(struct vm *vm)
 		free(vm->vcpus);
 	}
 
+	if (vm->gang_id >= 0)
+		sched_gang_free(vm->gang_id);
+
 	release_vm_memory(vm);
 
 	i = vm->vmid;
@@ -783,14 +807,158 @@ int vm_vcpus_init(struct vm *vm)
 	return 0;
 }
 
+/*
+ * set the weight and cap of all the vcpus of the VM, the
+ * vcpu which is scheduled by deadline is skipped.
+ */
+int vm_set_sched_param(struct vm *vm, int weight, int cap)
+{
+	struct vcpu *vcpu;
+	int ret;
+
+	if (!vm)
+		return -ENOENT;
+
+	if ((weight <= 0) || (cap < 0) || (cap > 100))
+		return -EINVAL;
+
+	vm_for_each_vcpu(vm, vcpu) {
+		if (task_is_dl(vcpu->task))
+			continue;
+
+		ret = task_set_credit(vcpu->task, weight, cap);
+		if (ret)
+			return ret;
+	}
+
+	vm->sched_weight = weight;
+	vm->sched_cap = cap;
+
+	return 0;
+}
+
+void vm_get_sched_stat(struct vm *vm, unsigned long *run_ns,
+		unsigned long *entitled_ns)
+{
+	struct vcpu *vcpu;
+
+	*run_ns = 0;
+	*entitled_ns = 0;
+
+	vm_for_each_vcpu(vm, vcpu) {
+		*run_ns += vcpu->task->credit.run_ns;
+		*entitled_ns += vcpu->task->credit.entitled_ns;
+	}
+}
+
+/*
+ * all the vcpus of the gang scheduled VM are dispatched in
+ * the same slot, so they must run on different pcpus.
+ */
+static void vm_gang_init(struct vm *vm)
+{
+	DECLARE_BITMAP(cpus, NR_CPUS);
+	struct vcpu *vcpu;
+	int cpu;
+
+	if (!(vm->flags & VM_FLAGS_GANG_SCHED))
+		return;
+
+	bitmap_zero(cpus, NR_CPUS);
+	vm_for_each_vcpu(vm, vcpu) {
+		cpu = vcpu_affinity(vcpu);
+		if (test_and_set_bit(cpu, cpus)) {
+			pr_warn("vm-%d vcpus share pcpu%d, gang sched disabled\n",
+					vm->vmid, cpu);
+			return;
+		}
+	}
+
+	vm->gang_id = sched_gang_alloc();
+	if (vm->gang_id < 0) {
+		pr_warn("no gang for vm-%d\n", vm->vmid);
+		vm->gang_id = -1;
+		return;
+	}
+
+	vm_for_each_vcpu(vm, vcpu) {
+		if (!task_is_dl(vcpu->task))
+			task_join_gang(vcpu->task, vm->gang_id);
+	}
+
+	pr_notice("vm-%d is gang scheduled in gang %d\n", vm->vmid, vm->gang_id);
+}
+
+static int vcpu_sched_param_of(struct device_node *node,
+		char *attr, int vcpu_id, uint32_t *value)
+{
+	uint32_t array[VM_MAX_VCPU];
+	int nr;
+
+	/*
+	 * one value for all the vcpus, or one value for
+	 * each vcpu.
+	 */
+	nr = of_get_u32_array(node, attr, array, VM_MAX_VCPU);
+	if (nr == 1)
+		*value = array[0];
+	else if (vcpu_id < nr)
+		*value = array[vcpu_id];
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+/*
+ * the vcpu is scheduled as a deadline task if the vm node
+ * has sched_runtime and sched_period (in us), sched_deadline
+ * is optional and equal to the period by default.
+ */
+static int vcpu_deadline_init(struct vm *vm, struct vcpu *vcpu)
+{
+	struct device_node *node = vm->dev_node;
+	uint32_t runtime, deadline, period;
+	int ret;
+
+	if (!node)
+		return 0;
+
+	if (vcpu_sched_param_of(node, "sched_runtime", vcpu->vcpu_id, &runtime) ||
+			vcpu_sched_param_of(node, "sched_period",
+				vcpu->vcpu_id, &period))
+		return 0;
+
+	if (vcpu_sched_param_of(node, "sched_deadline", vcpu->vcpu_id, &deadline))
+		deadline = period;
+
+	ret = task_set_deadline(vcpu->task, MICROSECS(runtime),
+			MICROSECS(deadline), MICROSECS(period));
+	if (ret) {
+		pr_err("%s: invalid deadline param %d/%d/%d\n",
+				vcpu->task->name, runtime, deadline, period);
+		return ret;
+	}
+
+	pr_notice("%s: runtime %dus deadline %dus period %dus\n",
+			vcpu->task->name, runtime, deadline, period);
+
+	return 0;
+}
+
 static int create_vcpus(struct vm *vm)
 {
-	int i, j;
+	int i, j, ret = 0;
 	struct vcpu *vcpu;
 
 	for (i = 0; i < vm->vcpu_nr; i++) {
 		vcpu = create_vcpu(vm, i);
-		if (!vcpu) {
+		if (!vcpu)
+			ret = -ENOMEM;
+		else
+			ret = vcpu_deadline_init(vm, vcpu);
+
+		if (ret) {
 			pr_err("create vcpu:%d for %s failed\n", i, vm->name);
 			for (j = 0; j < vm->vcpu_nr; j++) {
 				vcpu = vm->vcpus[j];
@@ -799,7 +967,7 @@ static int create_vcpus(struct vm *vm)
 				release_vcpu(vcpu);
 			}
 
-			return -ENOMEM;
+			return ret;
 		}
 	}
 
@@ -861,6 +1029,7 @@ static struct vm *__create_vm(struct vmtag *vme)
 	vm->load_address =
 		(void *)(vme->load_address ? vme->load_address : vme->entry);
 	vm->state = VM_STATE_OFFLINE;
+	vm->gang_id = -1;
 	init_list(&vm->vdev_list);
 	memcpy(vm->vcpu_affinity, vme->vcpu_affinity,
 			sizeof(uint32_t) * VM_MAX_VCPU);
@@ -918,6 +1087,16 @@ struct vm *create_vm(struct vmtag *vme, struct device_node *node)
 		goto release_vm;
 	}
 
+	ret = vm_set_sched_param(vm, vme->sched_weight ?
+			vme->sched_weight : VM_SCHED_WEIGHT_DEFAULT,
+			vme->sched_cap);
+	if (ret) {
+		pr_err("invalid sched param for vm\n");
+		goto release_vm;
+	}
+
+	vm_gang_init(vm);
+
 	if ((vm->flags & VM_FLAGS_HOST)) {
 		ASSERT(host_vm == NULL);
 		host_vm = vm;
@@ -1059,6 +1238,10 @@ int virt_init(void)
 	 * VMID 0 is reserved
 	 */
 	set_bit(0, vmid_bitmap);
+
+	vcpu_cache = kmem_cache_create("vcpu", sizeof(struct vcpu), NULL);
+	ASSERT(vcpu_cache != NULL);
+
 	vmm_init();
 
 	vm_daemon_init();
@@ -1090,6 +1273,35 @@ void start_all_vm(void)
 		start_native_vm(vm);
 }
 
+static void dump_vm_sched(void)
+{
+	unsigned long run, entitled;
+	struct vm *vm;
+
+	printf("VMID WEIGHT CAP GANG   RUN(ms) ENTL(ms) NAME\n");
+	for_each_vm(vm) {
+		vm_get_sched_stat(vm, &run, &entitled);
+		printf("%4d %6d %3d %4d %9ld %8ld %s\n", vm->vmid,
+				vm->sched_weight, vm->sched_cap, vm->gang_id,
+				run / 1000000, entitled / 1000000, vm->name);
+	}
+}
+
+static void dump_vm_mem(void)
+{
+	unsigned long total, resident;
+	struct vm *vm;
+
+	printf("VMID   MEM(MB)  RSS(MB) DEMAND NAME\n");
+	for_each_vm(vm) {
+		vm_mem_usage(vm, &total, &resident);
+		printf("%4d %9ld %8ld %6s %s\n", vm->vmid, total >> 20,
+				resident >> 20,
+				(vm->flags & VM_FLAGS_DEMAND_PAGING) ? "yes" : "no",
+				vm->name);
+	}
+}
+
 /*
  * vm start 0 - start the vm which vmid is 0
  */
@@ -1097,7 +1309,17 @@ static int vm_command_hdl(int argc, char **argv)
 {
 	uint32_t vmid;
 
-	if (argc > 2 && strcmp(argv[1], "start") == 0) {
+	if (argc > 1 && strcmp(argv[1], "mem") == 0) {
+		dump_vm_mem();
+	} else if (argc > 1 && strcmp(argv[1], "sched") == 0) {
+		if (argc > 4) {
+			vmid = atoi(argv[2]);
+			return vm_set_sched_param(get_vm_by_id(vmid),
+					atoi(argv[3]), atoi(argv[4]));
+		}
+
+		dump_vm_sched();
+	} else if (argc > 2 && strcmp(argv[1], "start") == 0) {
 		vmid = atoi(argv[2]);
 		if (vmid == 0)
 			start_all_vm();
@@ -21,6 +21,15 @@
 
 #define VM_IPA_SIZE (1UL << 40)
 
+/*
+ * the guest memory is allocated as 1G aligned runs of memory
+ * block when possible, so it can be mapped by the level 1 block
+ * of the stage 2 page table.
+ */
+#define MEM_RUN_SIZE		(1UL << 30)
+#define MEM_BLOCKS_IN_RUN	(MEM_RUN_SIZE >> MEM_BLOCK_SHIFT)
+#define IS_MEM_RUN_ALIGN(x)	(!((unsigned long)(x) & (MEM_RUN_SIZE - 1)))
+
 struct block_section {
 	unsigned long start;
 	unsigned long size;
@@ -30,11 +39,39 @@ struct block_section {
 	unsigned long current_index;
 	unsigned long *bitmap;
 	struct block_section *next;
+	struct list_head avail_list;
 };
 
+/*
+ * each pcpu caches some free memory block, the memory block
+ * is allocated from and freed to the local cache, and the
+ * cache is refilled from or flushed to the block section in
+ * batch when it is empty or full. the lock of the cache is
+ * only contended when other pcpu steals from it because the
+ * block sections have no free memory block.
+ */
+#define MEMBLOCK_CACHE_SIZE	16
+
+struct memblock_cache {
+	spinlock_t lock;
+	int nr;
+	uint32_t bfn[MEMBLOCK_CACHE_SIZE];
+} __cache_line_align;
+
+/*
+ * bs_avail      - the block sections which still have free
+ *                 memory block, the full section is removed
+ *                 from it, so it will not be scanned again.
+ * cached_blocks - the memory block in the pcpu caches.
+ */
 static struct block_section *bs_head;
+static LIST_HEAD(bs_avail);
 static DEFINE_SPIN_LOCK(bs_lock);
 static unsigned long free_blocks;
+static atomic_t cached_blocks;
+static struct memblock_cache memblock_cache[NR_CPUS];
+static struct kmem_cache *vmm_area_cache;
+static struct kmem_cache *mem_block_cache;
 
 #define mm_to_vm(__mm) container_of((__mm), struct vm, mm)
 #define VMA_SIZE(vma) ((vma)->end - (vma)->start)
@@ -104,18 +141,23 @@ int destroy_guest_mapping(struct mm_struct *mm, unsigned long vir, size_t size)
 	return ret;
 }
 
+static void vmm_area_ctor(void *obj)
+{
+	struct vmm_area *va = obj;
+
+	va->pstart = BAD_ADDRESS;
+}
+
 static struct vmm_area *__alloc_vmm_area_entry(unsigned long base, size_t size)
 {
 	struct vmm_area *va;
 
-	va = zalloc(sizeof(struct vmm_area));
+	va = kmem_cache_zalloc(vmm_area_cache);
 	if (!va)
 		return NULL;
 
 	va->start = base;
-	va->pstart = BAD_ADDRESS;
 	va->end = base + size;
-	va->flags = 0;
 
 	return va;
 }
@@ -142,14 +184,14 @@ repeat:
 		if (va->start == tmp->end) {
 			va->start = tmp->start;
 			list_del(&tmp->list);
-			free(tmp);
+			kmem_cache_free(vmm_area_cache, tmp);
 			goto repeat;
 		}
 
 		if (va->end == tmp->start) {
 			va->end = tmp->end;
 			list_del(&tmp->list);
-			free(tmp);
+			kmem_cache_free(vmm_area_cache, tmp);
 			goto repeat;
 		}
 
@@ -225,14 +267,45 @@ static int vmm_area_map_ln(struct mm_struct *mm, struct vmm_area *va)
 			va->pstart, VMA_SIZE(va), va->flags);
 }
 
+static int memblock_is_run(struct mem_block *block)
+{
+	uint32_t bfn = block->bfn;
+	int i;
+
+	if (!IS_MEM_RUN_ALIGN(BFN2PHY(bfn)))
+		return 0;
+
+	for (i = 0; i < MEM_BLOCKS_IN_RUN; i++) {
+		if (!block || (block->bfn != bfn + i))
+			return 0;
+		block = block->next;
+	}
+
+	return 1;
+}
+
 static int vmm_area_map_bk(struct mm_struct *mm, struct vmm_area *va)
 {
 	struct mem_block *block = va->b_head;;
 	unsigned long base = va->start;
 	unsigned long size = VMA_SIZE(va);
-	int ret;
+	int ret, i;
 
 	while (block) {
+		if (IS_MEM_RUN_ALIGN(base) && (size >= MEM_RUN_SIZE) &&
+				memblock_is_run(block)) {
+			ret = __create_guest_mapping(mm, base, BFN2PHY(block->bfn),
+					MEM_RUN_SIZE, va->flags | __VM_HUGE_1G | VM_GUEST);
+			if (ret)
+				return ret;
+
+			for (i = 0; i < MEM_BLOCKS_IN_RUN; i++)
+				block = block->next;
+			base += MEM_RUN_SIZE;
+			size -= MEM_RUN_SIZE;
+			continue;
+		}
+
 		ret = __create_guest_mapping(mm, base, BFN2PHY(block->bfn),
 				MEM_BLOCK_SIZE, va->flags | VM_HUGE | VM_GUEST);
 		if (ret)
@@ -308,7 +381,7 @@ out:
 out_err_right:
 	if (left) {
 		list_del(&left->list);
-		free(left);
+		kmem_cache_free(vmm_area_cache, left);
 	}
 	return NULL;
 }
@@ -466,18 +539,19 @@ void release_vm_memory(struct vm *vm)
 	list_for_each_entry_safe(va, n, &mm->vmm_area_used, list) {
 		release_vmm_area_memory(va);
 		list_del(&va->list);
-		free(va);
+		kmem_cache_free(vmm_area_cache, va);
 	}
 
 	list_for_each_entry_safe(va, n, &mm->vmm_area_free, list) {
 		list_del(&va->list);
-		free(va);
+		kmem_cache_free(vmm_area_cache, va);
 	}
 
 	/* release the vm0's memory belong to this vm */
 	release_vmm_area_in_vm0(vm);
 
 	free_pages((void *)mm->pgdp);
+	mm->nr_mem_blocks = 0;
 }
 
 unsigned long create_hvm_shmem_map(struct vm *vm,
@@ -528,6 +602,58 @@ int copy_from_guest(void *target, void __guest *src, size_t size)
 	return 0;
 }
 
+static struct vmm_area *__find_vmm_area(struct mm_struct *mm,
+		unsigned long addr)
+{
+	struct vmm_area *va;
+
+	list_for_each_entry(va, &mm->vmm_area_used, list) {
+		if ((addr >= va->start) && (addr < va->end))
+			return va;
+	}
+
+	return NULL;
+}
+
+/*
+ * allocate and map the memory block of the on demand vmm_area
+ * which the address belongs to, need hold the mm->lock. return
+ * -ENOENT if the address is not in an on demand vmm_area.
+ */
+static int __vm_populate_memblock(struct mm_struct *mm, unsigned long addr)
+{
+	unsigned long base = ALIGN(addr, MEM_BLOCK_SIZE);
+	struct mem_block *block;
+	struct vmm_area *va;
+	int ret;
+
+	va = __find_vmm_area(mm, addr);
+	if (!va || !(va->flags & __VM_DEMAND))
+		return -ENOENT;
+
+	block = vmm_alloc_memblock();
+	if (!block)
+		return -ENOMEM;
+
+	ret = __create_guest_mapping(mm, base, BFN2PHY(block->bfn),
+			MEM_BLOCK_SIZE, va->flags | VM_HUGE | VM_GUEST);
+	if (ret) {
+		vmm_free_memblock(block);
+		return ret;
+	}
+
+	block->next = va->b_head;
+	va->b_head = block;
+	mm->nr_mem_blocks++;
+
+	return 0;
+}
+
+/*
+ * the host may access the on demand memory before the guest
+ * touches it, such as loading the image, so the memory block
+ * is populated here if it is not mapped.
+ */
 int translate_guest_ipa(struct mm_struct *mm,
 		unsigned long offset, unsigned long *pa)
 {
@@ -535,11 +661,61 @@ int translate_guest_ipa(struct mm_struct *mm,
 
 	spin_lock(&mm->lock);
 	ret = arch_translate_guest_ipa(mm, offset, pa);
+	if (ret && !__vm_populate_memblock(mm, offset))
+		ret = arch_translate_guest_ipa(mm, offset, pa);
 	spin_unlock(&mm->lock);
 
 	return ret;
 }
 
+/*
+ * called from the stage-2 translation fault of the guest, the
+ * other vcpu may have mapped the block when waiting the lock.
+ * the memory block of the on demand vm is not reserved when the
+ * vm is created, so the population may fail with -ENOMEM when
+ * the memory block pool is overcommitted.
+ */
+int vm_demand_fault(struct vm *vm, unsigned long ipa)
+{
+	struct mm_struct *mm = &vm->mm;
+	unsigned long pa;
+	int ret;
+
+	/* do not slow down the mmio trap of other vm */
+	if (!(vm->flags & VM_FLAGS_DEMAND_PAGING))
+		return -ENOENT;
+
+	spin_lock(&mm->lock);
+	if (!arch_translate_guest_ipa(mm, ipa, &pa))
+		ret = 0;
+	else
+		ret = __vm_populate_memblock(mm, ipa);
+	spin_unlock(&mm->lock);
+
+	return ret;
+}
+
+void vm_mem_usage(struct vm *vm, unsigned long *total,
+		unsigned long *resident)
+{
+	struct mm_struct *mm = &vm->mm;
+	struct vmm_area *va;
+
+	*total = *resident = 0;
+
+	spin_lock(&mm->lock);
+	list_for_each_entry(va, &mm->vmm_area_used, list) {
+		if (!(va->flags & VM_NORMAL))
+			continue;
+
+		*total += VMA_SIZE(va);
+		if ((va->flags & VM_MAP_TYPE_MASK) != VM_MAP_BK)
+			*resident += VMA_SIZE(va);
+	}
+	*resident += mm->nr_mem_blocks << MEM_BLOCK_SHIFT;
+	spin_unlock(&mm->lock);
+}
+
 static int do_vm_mmap(struct mm_struct *mm, unsigned long hvm_mmap_base,
 		unsigned long offset, unsigned long size)
 {
@@ -620,9 +796,8 @@ struct vmm_area *vm_mmap(struct vm *vm, unsigned long offset, size_t size)
 
 static int __alloc_vm_memory(struct mm_struct *mm, struct vmm_area *va)
 {
-	int i, count;
+	struct mem_block *block, **tail;
 	unsigned long base;
-	struct mem_block *block;
 
 	base = ALIGN(va->start, MEM_BLOCK_SIZE);
 	if (base != va->start) {
@@ -632,19 +807,42 @@ static int __alloc_vm_memory(struct mm_struct *mm, struct vmm_area *va)
 
 	va->b_head = NULL;
 	va->flags |= VM_MAP_BK;
-	count = VMA_SIZE(va) >> MEM_BLOCK_SHIFT;
 
 	/*
-	 * here get all the memory block for the vm
-	 * TBD: get contiueous memory or not contiueous ?
+	 * the memory block of the on demand vmm_area is allocated
+	 * and mapped when the guest first accesses it.
 	 */
-	for (i = 0; i < count; i++) {
+	if (va->flags & __VM_DEMAND)
+		return 0;
+
+	/*
+	 * the memory block is linked by the address order, the 1G
+	 * aligned part of the vmm_area try to get a 1G aligned run
+	 * of memory block first, then it can be mapped as the level
+	 * 1 block, otherwise get the memory block one by one.
+	 */
+	tail = &va->b_head;
+	while (base < va->end) {
+		if (IS_MEM_RUN_ALIGN(base) && (va->end - base >= MEM_RUN_SIZE)) {
+			block = vmm_alloc_memblock_run();
+			if (block) {
+				*tail = block;
+				while (*tail)
+					tail = &(*tail)->next;
+				mm->nr_mem_blocks += MEM_BLOCKS_IN_RUN;
+				base += MEM_RUN_SIZE;
+				continue;
+			}
+		}
+
 		block = vmm_alloc_memblock();
 		if (!block)
 			return -ENOMEM;
 
-		block->next = va->b_head;
-		va->b_head = block;
+		*tail = block;
+		tail = &block->next;
+		mm->nr_mem_blocks++;
+		base += MEM_BLOCK_SIZE;
 	}
 
 	return 0;
@@ -664,6 +862,9 @@ int alloc_vm_memory(struct vm *vm)
 			goto out;
 		}
 
+		if (va->flags & __VM_DEMAND)
+			continue;
+
 		if (map_vmm_area(mm, va, 0)) {
 			pr_err("map memory for vm-%d failed\n", vm->vmid);
 			goto out;
@@ -814,7 +1015,7 @@ int vm_mm_init(struct vm *vm)
 			pr_debug("drop unused vmm_area [0x%lx 0x%lx]\n",
 					va->start, va->end);
 			list_del(&va->list);
-			free(va);
+			kmem_cache_free(vmm_area_cache, va);
 			continue;
 		}
 
@@ -831,7 +1032,21 @@ int vm_mm_init(struct vm *vm)
 
 int vmm_has_enough_memory(size_t size)
 {
-	return ((size >> MEM_BLOCK_SHIFT) <= free_blocks);
+	return ((size >> MEM_BLOCK_SHIFT) <=
+			free_blocks + atomic_read(&cached_blocks));
+}
+
+/*
+ * keep the block section on the bs_avail list only when it
+ * has free memory block, called with bs_lock held.
+ */
+static void update_section_avail(struct block_section *bs)
+{
+	if ((bs->free_blocks == 0) && bs->avail_list.next) {
+		list_del(&bs->avail_list);
+	} else if ((bs->free_blocks != 0) && !bs->avail_list.next) {
+		list_add_tail(&bs_avail, &bs->avail_list);
+	}
 }
 
 static int __vmm_free_memblock(uint32_t bfn)
@@ -845,6 +1060,7 @@ static int __vmm_free_memblock(uint32_t bfn)
 			clear_bit(bfn, bs->bitmap);
 			bs->free_blocks += 1;
 			free_blocks += 1;
+			update_section_avail(bs);
 			return 0;
 		}
 
@@ -856,19 +1072,6 @@ static int __vmm_free_memblock(uint32_t bfn)
 	return -EINVAL;
 }
 
-int vmm_free_memblock(struct mem_block *mb)
-{
-	uint32_t bfn = mb->bfn;
-	int ret;
-
-	free(mb);
-	spin_lock(&bs_lock);
-	ret = __vmm_free_memblock(bfn);
-	spin_unlock(&bs_lock);
-
-	return ret;
-}
-
 static int get_memblock_from_section(struct block_section *bs, uint32_t *bfn)
 {
 	uint32_t id;
@@ -883,41 +1086,273 @@ static int get_memblock_from_section(struct block_section *bs, uint32_t *bfn)
 	bs->free_blocks -= 1;
 	free_blocks -= 1;
 	*bfn = (bs->start >> MEM_BLOCK_SHIFT) + id;
+	update_section_avail(bs);
 
 	return 0;
 }
 
-struct mem_block *vmm_alloc_memblock(void)
+/*
+ * refill and flush are called with the mc->lock held, the
+ * lock order is mc->lock then bs_lock.
+ */
+static void memblock_cache_refill(struct memblock_cache *mc)
 {
-	struct block_section *bs;
-	struct mem_block *mb;
-	int success = 0, ret;
-	uint32_t bfn = 0;
+	struct block_section *bs, *tmp;
 
 	spin_lock(&bs_lock);
-	bs = bs_head;
-	while (bs) {
-		if (bs->free_blocks != 0) {
-			ret = get_memblock_from_section(bs, &bfn);
-			if (ret == 0) {
-				success = 1;
-				break;
-			} else {
+	list_for_each_entry_safe(bs, tmp, &bs_avail, avail_list) {
+		while (mc->nr < (MEMBLOCK_CACHE_SIZE / 2)) {
+			if (get_memblock_from_section(bs, &mc->bfn[mc->nr])) {
 				pr_err("memory block content wrong\n");
+				break;
 			}
+
+			mc->nr++;
+			atomic_inc(&cached_blocks);
+			if (bs->free_blocks == 0)
+				break;
 		}
-		bs = bs->next;
+
+		if (mc->nr == (MEMBLOCK_CACHE_SIZE / 2))
+			break;
 	}
 	spin_unlock(&bs_lock);
+}
+
+/*
+ * return the oldest memory block in the cache to the block
+ * section, the recently freed ones are kept.
+ */
+static void memblock_cache_flush(struct memblock_cache *mc, int nr)
+{
+	int i;
+
+	spin_lock(&bs_lock);
+	for (i = 0; i < nr; i++)
+		__vmm_free_memblock(mc->bfn[i]);
+	spin_unlock(&bs_lock);
+	atomic_sub(nr, &cached_blocks);
+
+	mc->nr -= nr;
+	memmove(&mc->bfn[0], &mc->bfn[nr], mc->nr * sizeof(uint32_t));
+}
+
+static int memblock_cache_pop(struct memblock_cache *mc, uint32_t *bfn)
+{
+	if (mc->nr == 0)
+		return -ENOSPC;
+
+	*bfn = mc->bfn[--mc->nr];
+	atomic_dec(&cached_blocks);
+
+	return 0;
+}
+
+/*
+ * the block sections have no free memory block, take one
+ * from the cache of other pcpu. only one cache lock is held
+ * here, so two pcpus can steal from each other.
+ */
+static int memblock_cache_steal(uint32_t *bfn)
+{
+	struct memblock_cache *mc;
+	int cpu, ret;
 
-	if (!success)
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (cpu == smp_processor_id())
+			continue;
+
+		mc = &memblock_cache[cpu];
+		if (mc->nr == 0)
+			continue;
+
+		spin_lock(&mc->lock);
+		ret = memblock_cache_pop(mc, bfn);
+		spin_unlock(&mc->lock);
+		if (ret == 0)
+			return 0;
+	}
+
+	return -ENOSPC;
+}
+
+static int __vmm_alloc_memblock(uint32_t *bfn)
+{
+	struct memblock_cache *mc;
+	unsigned long flags;
+	int ret;
+
+	local_irq_save(flags);
+	mc = &memblock_cache[smp_processor_id()];
+	spin_lock(&mc->lock);
+	if (mc->nr == 0)
+		memblock_cache_refill(mc);
+	ret = memblock_cache_pop(mc, bfn);
+	spin_unlock(&mc->lock);
+
+	if (ret && atomic_read(&cached_blocks))
+		ret = memblock_cache_steal(bfn);
+	local_irq_restore(flags);
+
+	return ret;
+}
+
+static void __vmm_put_memblock(uint32_t bfn)
+{
+	struct memblock_cache *mc;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	mc = &memblock_cache[smp_processor_id()];
+	spin_lock(&mc->lock);
+	if (mc->nr == MEMBLOCK_CACHE_SIZE)
+		memblock_cache_flush(mc, MEMBLOCK_CACHE_SIZE / 2);
+	mc->bfn[mc->nr++] = bfn;
+	atomic_inc(&cached_blocks);
+	spin_unlock(&mc->lock);
+	local_irq_restore(flags);
+}
+
+int vmm_free_memblock(struct mem_block *mb)
+{
+	uint32_t bfn = mb->bfn;
+
+	kmem_cache_free(mem_block_cache, mb);
+	__vmm_put_memblock(bfn);
+
+	return 0;
+}
+
+/*
+ * the hypervisor heap borrows the memory block without the
+ * struct mem_block, since the allocation of it may need the
+ * heap to grow.
+ */
+unsigned long vmm_borrow_memblock(void)
+{
+	uint32_t bfn;
+
+	if (__vmm_alloc_memblock(&bfn))
+		return 0;
+
+	return BFN2PHY(bfn);
+}
+
+void vmm_return_memblock(unsigned long base)
+{
+	__vmm_put_memblock(PHY2BFN(base));
+}
+
+/*
+ * find a free run of memory block which is 1G aligned in the
+ * physical address.
+ */
+static int get_memblock_run_from_section(struct block_section *bs, uint32_t *bfn)
+{
+	unsigned long offset, id;
+
+	if (bs->free_blocks < MEM_BLOCKS_IN_RUN)
+		return -ENOSPC;
+
+	offset = PHY2BFN(bs->start) & (MEM_BLOCKS_IN_RUN - 1);
+	id = bitmap_find_next_zero_area_off(bs->bitmap, bs->total_blocks,
+			0, MEM_BLOCKS_IN_RUN, MEM_BLOCKS_IN_RUN - 1, offset);
+	if (id + MEM_BLOCKS_IN_RUN > bs->total_blocks)
+		return -ENOSPC;
+
+	bitmap_set(bs->bitmap, id, MEM_BLOCKS_IN_RUN);
+	bs->free_blocks -= MEM_BLOCKS_IN_RUN;
+	free_blocks -= MEM_BLOCKS_IN_RUN;
+	*bfn = PHY2BFN(bs->start) + id;
+	update_section_avail(bs);
+
+	return 0;
+}
+
+/*
+ * allocate a 1G aligned run of memory block, the mem_block
+ * of the run is linked by the bfn order, return NULL if there
+ * is no such run.
+ */
+static int __vmm_alloc_memblock_run(uint32_t *bfn)
+{
+	struct block_section *bs, *tmp;
+	int ret = -ENOSPC;
+
+	spin_lock(&bs_lock);
+	list_for_each_entry_safe(bs, tmp, &bs_avail, avail_list) {
+		ret = get_memblock_run_from_section(bs, bfn);
+		if (ret == 0)
+			break;
+	}
+	spin_unlock(&bs_lock);
+
+	return ret;
+}
+
+struct mem_block *vmm_alloc_memblock_run(void)
+{
+	struct mem_block *head = NULL, *mb;
+	struct memblock_cache *mc;
+	unsigned long flags;
+	uint32_t bfn = 0;
+	int i;
+
+	/*
+	 * the memory block in the local cache may split a free
+	 * run, give them back and try again.
+	 */
+	if (__vmm_alloc_memblock_run(&bfn)) {
+		local_irq_save(flags);
+		mc = &memblock_cache[smp_processor_id()];
+		spin_lock(&mc->lock);
+		if (mc->nr)
+			memblock_cache_flush(mc, mc->nr);
+		spin_unlock(&mc->lock);
+		local_irq_restore(flags);
+
+		if (__vmm_alloc_memblock_run(&bfn))
+			return NULL;
+	}
+
+	for (i = MEM_BLOCKS_IN_RUN - 1; i >= 0; i--) {
+		mb = kmem_cache_alloc(mem_block_cache);
+		if (!mb)
+			goto out_free;
+
+		mb->bfn = bfn + i;
+		mb->next = head;
+		head = mb;
+	}
+
+	return head;
+
+out_free:
+	while (head) {
+		mb = head;
+		head = head->next;
+		kmem_cache_free(mem_block_cache, mb);
+	}
+
+	spin_lock(&bs_lock);
+	for (i = 0; i < MEM_BLOCKS_IN_RUN; i++)
+		__vmm_free_memblock(bfn + i);
+	spin_unlock(&bs_lock);
+
+	return NULL;
+}
+
+struct mem_block *vmm_alloc_memblock(void)
+{
+	struct mem_block *mb;
+	uint32_t bfn = 0;
+
+	if (__vmm_alloc_memblock(&bfn))
 		return NULL;
 
-	mb = malloc(sizeof(struct mem_block));
+	mb = kmem_cache_alloc(mem_block_cache);
 	if (!mb) {
-		spin_lock(&bs_lock);
-		__vmm_free_memblock(bfn);
-		spin_unlock(&bs_lock);
+		__vmm_put_memblock(bfn);
 		return NULL;
 	}
 
@@ -932,10 +1367,19 @@ void vmm_init(void)
 	struct memory_region *region;
 	struct block_section *bs;
 	unsigned long start, end;
-	int size;
+	int size, i;
 
 	ASSERT(!is_list_empty(&mem_list));
 
+	vmm_area_cache = kmem_cache_create("vmm_area",
+			sizeof(struct vmm_area), vmm_area_ctor);
+	mem_block_cache = kmem_cache_create("mem_block",
+			sizeof(struct mem_block), NULL);
+	ASSERT(vmm_area_cache && mem_block_cache);
+
+	for (i = 0; i < NR_CPUS; i++)
+		spin_lock_init(&memblock_cache[i].lock);
+
 	/*
 	 * all the free memory will used as the guest VM
 	 * memory. The guest memory will allocated as block.
@@ -976,5 +1420,6 @@ void vmm_init(void)
 
 		bs->next = bs_head;
 		bs_head = bs;
+		list_add_tail(&bs_avail, &bs->avail_list);
 	}
 }
@@ -155,6 +155,17 @@ VCPU_VMODULE_ACTION(suspend)
 VCPU_VMODULE_ACTION(resume)
 VCPU_VMODULE_ACTION(dump)
 
+void migrate_vcpu_vmodule_state(struct vcpu *vcpu, int cpu)
+{
+	struct vmodule *vmodule;
+
+	list_for_each_entry(vmodule, &vmodule_list, list) {
+		if (vmodule->state_migrate)
+			vmodule->state_migrate(vcpu,
+				vcpu->context[vmodule->id], cpu);
+	}
+}
+
 static int vmodules_init(void)
 {
 	struct module_id *mid;
@@ -277,7 +277,8 @@ static void *vrtc_init(struct vm *vm, struct device_node *node)
 	dev->vdev.reset = vrtc_reset;
 	vdev_add(&dev->vdev);
 
-	init_timer(&dev->alarm_timer, vrtc_alarm_function, (unsigned long)dev);
+	init_deferrable_timer(&dev->alarm_timer, vrtc_alarm_function,
+			(unsigned long)dev);
 
 	return (void *)dev;
 }
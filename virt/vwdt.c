@@ -290,7 +290,7 @@ static void *vwdt_init(struct vm *vm, struct device_node *node)
 	dev->vdev.reset = vwdt_reset;
 	vdev_add(&dev->vdev);
 
-	init_timer(&dev->wdt_timer, vwdt_timer_expire,
+	init_deferrable_timer(&dev->wdt_timer, vwdt_timer_expire,
 			(unsigned long)dev);
 
 	return NULL;